@@ -19,11 +19,117 @@
 
 #include <sys/types.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * enum memtrack_backend
+ *
+ * Source of the per-process memory stats.
+ *
+ * MEMTRACK_BACKEND_AUTO uses the memtrack HAL, or the kernel backend if the
+ * device has no memtrack HAL.
+ * MEMTRACK_BACKEND_HAL only uses the memtrack HAL.
+ * MEMTRACK_BACKEND_DMABUF reads dma-bufs held or mapped by each process from
+ * procfs.  Only graphics memory is reported; buffers shared by several
+ * processes are divided between them in the pss.
+ * MEMTRACK_BACKEND_DRM reads the drm-* keys of DRM clients in
+ * /proc/<pid>/fdinfo.  Only GL memory is reported.
+ * MEMTRACK_BACKEND_KERNEL reports graphics memory as MEMTRACK_BACKEND_DMABUF
+ * and GL memory as MEMTRACK_BACKEND_DRM.
+ * MEMTRACK_BACKEND_REPLAY serves the trace loaded by memtrack_replay_load.
+ */
+enum memtrack_backend {
+    MEMTRACK_BACKEND_AUTO = 0,
+    MEMTRACK_BACKEND_HAL = 1,
+    MEMTRACK_BACKEND_DMABUF = 2,
+    MEMTRACK_BACKEND_DRM = 3,
+    MEMTRACK_BACKEND_KERNEL = 4,
+    MEMTRACK_BACKEND_REPLAY = 5,
+};
+
+/**
+ * memtrack_set_backend
+ *
+ * Select the source used by all subsequent queries in the process.  The
+ * default is MEMTRACK_BACKEND_AUTO.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_set_backend(enum memtrack_backend backend);
+
+/**
+ * memtrack_backend_calls
+ *
+ * Return the number of queries made to the backend by the process so far,
+ * one per pid and memory type.  Queries answered by the result cache are not
+ * counted.
+ */
+uint64_t memtrack_backend_calls(void);
+
+/**
+ * memtrack_record_start
+ *
+ * Start recording every response of the selected backend, with its pid,
+ * type, status, records and latency, into a trace at path.  The file is
+ * truncated.  Only one recording can be active in a process.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_record_start(const char *path);
+
+/**
+ * memtrack_record_stop
+ *
+ * Stop recording and write out the rest of the trace.
+ *
+ * Returns 0 on success, -errno if any part of the trace could not be
+ * written.
+ */
+int memtrack_record_stop(void);
+
+#define MEMTRACK_REPLAY_TIMING (1u << 0)
+
+/**
+ * memtrack_replay_load
+ *
+ * Load a trace written by memtrack_record_start and select
+ * MEMTRACK_BACKEND_REPLAY.  Queries for a pid and type return the responses
+ * recorded for them in turn, starting over after the last one, and fail
+ * with -ESRCH if none were recorded.  With MEMTRACK_REPLAY_TIMING each
+ * response is delayed by its recorded latency.  While replaying,
+ * memtrack_list_processes lists the pids in the trace.
+ *
+ * Must not be called concurrently with queries.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_replay_load(const char *path, uint32_t flags);
+
+/**
+ * enum memtrack_type
+ *
+ * Kinds of memory tracked for each process.  Values match the memtrack HAL.
+ */
+enum memtrack_type {
+    MEMTRACK_TYPE_OTHER = 0,
+    MEMTRACK_TYPE_GL = 1,
+    MEMTRACK_TYPE_GRAPHICS = 2,
+    MEMTRACK_TYPE_MULTIMEDIA = 3,
+    MEMTRACK_TYPE_CAMERA = 4,
+    MEMTRACK_NUM_TYPES
+};
+
+/**
+ * Masks of memtrack_type values, for memtrack_proc_get_types and
+ * memtrack_proc_valid_types.
+ */
+#define MEMTRACK_TYPE_MASK(type) (1u << (type))
+#define MEMTRACK_TYPE_MASK_ALL ((1u << MEMTRACK_NUM_TYPES) - 1)
+
 /**
  * struct memtrack_proc
  *
@@ -50,6 +156,134 @@ struct memtrack_proc *memtrack_proc_new(void);
  */
 void memtrack_proc_destroy(struct memtrack_proc *p);
 
+/**
+ * struct memtrack_pool
+ *
+ * an opaque pool of process memory stats handles.  Handles returned to the
+ * pool keep their record buffers, so a handle taken from the pool again can
+ * be filled without allocating.  Created with memtrack_pool_new, destroyed
+ * by memtrack_pool_destroy.
+ */
+struct memtrack_pool;
+
+/**
+ * memtrack_pool_new
+ *
+ * Return a new handle pool retaining at most max_retained_bytes of idle
+ * handles and their buffers.
+ *
+ * Returns NULL on error.
+ */
+struct memtrack_pool *memtrack_pool_new(size_t max_retained_bytes);
+
+/**
+ * memtrack_pool_destroy
+ *
+ * Free the pool and the idle handles it retains.  Handles still taken from
+ * the pool remain valid and may be freed with memtrack_proc_destroy.
+ */
+void memtrack_pool_destroy(struct memtrack_pool *pool);
+
+/**
+ * memtrack_pool_get
+ *
+ * Return a handle from the pool, or a new handle if the pool is empty.  Idle
+ * handles are kept per thread first, so a thread that returns and takes
+ * handles does not contend with other threads.
+ *
+ * Returns NULL on error.
+ */
+struct memtrack_proc *memtrack_pool_get(struct memtrack_pool *pool);
+
+/**
+ * memtrack_pool_put
+ *
+ * Return a handle to the pool.  The handle is freed instead if retaining it
+ * would exceed the pool's limit.
+ */
+void memtrack_pool_put(struct memtrack_pool *pool, struct memtrack_proc *p);
+
+/**
+ * struct memtrack_shared_proc
+ *
+ * a handle to the memory stats of a process that one thread refreshes while
+ * others read it.  Created with memtrack_shared_proc_new, destroyed by
+ * memtrack_shared_proc_destroy.
+ */
+struct memtrack_shared_proc;
+
+/**
+ * struct memtrack_proc_totals
+ *
+ * the totals of a process, as returned by the memtrack_proc_* accessors at
+ * the time of a refresh.  generation counts the refreshes of the handle.
+ */
+struct memtrack_proc_totals {
+    pid_t pid;
+    uint32_t valid_types;
+    uint64_t generation;
+    ssize_t graphics_total;
+    ssize_t graphics_pss;
+    ssize_t gl_total;
+    ssize_t gl_pss;
+    ssize_t other_total;
+    ssize_t other_pss;
+};
+
+/**
+ * memtrack_shared_proc_new
+ *
+ * Return a new shared handle.
+ *
+ * Returns NULL on error.
+ */
+struct memtrack_shared_proc *memtrack_shared_proc_new(void);
+
+/**
+ * memtrack_shared_proc_destroy
+ *
+ * Free a shared handle.  No thread may be using it.
+ */
+void memtrack_shared_proc_destroy(struct memtrack_shared_proc *s);
+
+/**
+ * memtrack_shared_proc_refresh
+ *
+ * Query the stats of pid, as memtrack_proc_get, and publish them to readers
+ * of the handle at once.  Readers keep seeing the previous totals until the
+ * query completes, and if it fails.  Concurrent refreshes are serialized.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_shared_proc_refresh(struct memtrack_shared_proc *s, pid_t pid);
+
+/**
+ * memtrack_shared_proc_read
+ *
+ * Copy the totals of the last refresh into totals.  Can be called from any
+ * thread, concurrently with a refresh, and never blocks on one.
+ *
+ * Returns 0 on success, -ENODATA if the handle was never refreshed, -EAGAIN
+ * if refreshes kept overtaking the copy, -errno on other errors.
+ */
+int memtrack_shared_proc_read(struct memtrack_shared_proc *s,
+                              struct memtrack_proc_totals *totals);
+
+#define MEMTRACK_LIST_SKIP_KTHREADS (1u << 0)
+
+/**
+ * memtrack_list_processes
+ *
+ * Fill pids with up to count process ids from /proc, in ascending order.
+ * With MEMTRACK_LIST_SKIP_KTHREADS in flags, kernel threads, which never own
+ * memory tracked by memtrack, are left out.  While a trace is replayed, the
+ * pids in the trace are listed instead.
+ *
+ * Returns the number of processes found, which is larger than count if pids
+ * was too small, or -errno on error.
+ */
+ssize_t memtrack_list_processes(pid_t *pids, size_t count, uint32_t flags);
+
 /**
  * memtrack_proc_get
  *
@@ -64,6 +298,264 @@ void memtrack_proc_destroy(struct memtrack_proc *p);
  */
 int memtrack_proc_get(struct memtrack_proc *p, pid_t pid);
 
+/**
+ * memtrack_proc_get_types
+ *
+ * Same as memtrack_proc_get, but only queries the types in type_mask, a mask
+ * of MEMTRACK_TYPE_MASK(type) values.  Accessors that depend on a type that
+ * was not queried return -ENODATA.  For example memtrack_proc_graphics_total
+ * and memtrack_proc_gl_total only need
+ * MEMTRACK_TYPE_MASK(MEMTRACK_TYPE_GRAPHICS) | MEMTRACK_TYPE_MASK(MEMTRACK_TYPE_GL).
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_proc_get_types(struct memtrack_proc *p, pid_t pid, uint32_t type_mask);
+
+/**
+ * memtrack_proc_get_partial
+ *
+ * Same as memtrack_proc_get, but a type that fails does not end the query:
+ * every type is queried and its status recorded in the handle.  Accessors
+ * that depend on a failed type return its error, the others return valid
+ * data.  Use memtrack_proc_type_status or memtrack_proc_valid_types to
+ * find out which types are valid.
+ *
+ * Returns 0 if at least one type is valid, -errno if every type failed.
+ */
+int memtrack_proc_get_partial(struct memtrack_proc *p, pid_t pid);
+
+/**
+ * memtrack_proc_type_status
+ *
+ * Return the status of one type in the last query on the handle: 0 if its
+ * stats are valid, -ENODATA if it was not queried, or the -errno it failed
+ * with.
+ */
+int memtrack_proc_type_status(struct memtrack_proc *p, enum memtrack_type type);
+
+/**
+ * memtrack_proc_valid_types
+ *
+ * Return a mask with bit (1 << type) set for every type whose stats are
+ * valid in the handle.
+ */
+uint32_t memtrack_proc_valid_types(struct memtrack_proc *p);
+
+/**
+ * struct memtrack_proc_id
+ *
+ * a stable identity for a process.  pids are recycled, but a (pid,
+ * start_time) pair names a single process for the lifetime of the system.
+ * start_time is in clock ticks since boot, as in /proc/<pid>/stat, or 0 if
+ * it is unknown, in which case only the pid is matched.
+ */
+struct memtrack_proc_id {
+    pid_t pid;
+    uint64_t start_time;
+};
+
+/**
+ * memtrack_proc_id_get
+ *
+ * Fill id with the identity of the process currently running as pid.  If
+ * the start time cannot be read, id->start_time is set to 0.
+ *
+ * Returns 0 on success, -errno on error (-ENOENT if there is no such process).
+ */
+int memtrack_proc_id_get(pid_t pid, struct memtrack_proc_id *id);
+
+/**
+ * memtrack_proc_id_alive
+ *
+ * Return 1 if the process named by id is still running, 0 if it has exited
+ * or its pid now belongs to another process, -errno on error.  If
+ * id->start_time is 0, only whether the pid exists is checked.
+ */
+int memtrack_proc_id_alive(const struct memtrack_proc_id *id);
+
+/**
+ * memtrack_proc_get_id
+ *
+ * Same as memtrack_proc_get, but for the process named by id.  Fails if the
+ * pid does not belong to that process either before or after the stats are
+ * read, so the result can never be attributed to a recycled pid.  The
+ * identity is kept in the handle and can be read back with memtrack_proc_identity.
+ *
+ * Returns 0 on success, -ESRCH if the process is gone, -errno on error.
+ */
+int memtrack_proc_get_id(struct memtrack_proc *p, const struct memtrack_proc_id *id);
+
+/**
+ * memtrack_proc_identity
+ *
+ * Fill id with the identity of the process whose stats are in the handle.
+ * start_time is 0 if the handle was filled with memtrack_proc_get, which
+ * does not track identity.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_proc_identity(struct memtrack_proc *p, struct memtrack_proc_id *id);
+
+/**
+ * memtrack_proc_callback
+ *
+ * Completion callback of memtrack_proc_get_async, called on a library worker
+ * thread with the handle, the result memtrack_proc_get would have returned,
+ * and the cookie passed in.
+ */
+typedef void (*memtrack_proc_callback)(struct memtrack_proc *p, int ret, void *cookie);
+
+/**
+ * memtrack_async_configure
+ *
+ * Set the number of worker threads serving asynchronous queries and the
+ * maximum number of queries in flight (queued, running, or completed but
+ * not yet reaped).  The defaults are 2 threads and 256 queries.  Must be
+ * called before the first asynchronous query.
+ *
+ * Returns 0 on success, -EBUSY if the workers already started, -errno on
+ * other errors.
+ */
+int memtrack_async_configure(unsigned int threads, size_t max_in_flight);
+
+/**
+ * memtrack_proc_get_async
+ *
+ * Queue a memtrack_proc_get of pid into p on the worker threads.  The handle
+ * must not be used until the query completes.  On completion cb is called;
+ * if cb is NULL the result is instead queued for memtrack_async_reap and the
+ * eventfd returned by memtrack_async_eventfd is signalled.
+ *
+ * Returns 0 if the query was queued, -EAGAIN if too many queries are in
+ * flight, -errno on other errors.
+ */
+int memtrack_proc_get_async(struct memtrack_proc *p, pid_t pid, memtrack_proc_callback cb,
+        void *cookie);
+
+/**
+ * memtrack_async_eventfd
+ *
+ * Return a non-blocking eventfd, owned by the library, that becomes readable
+ * when queries issued without a callback complete.  Suitable for poll and
+ * epoll; memtrack_async_reap clears it.
+ *
+ * Returns the fd on success, -errno on error.
+ */
+int memtrack_async_eventfd(void);
+
+/**
+ * struct memtrack_async_result
+ *
+ * a completed query issued without a callback.
+ */
+struct memtrack_async_result {
+    struct memtrack_proc *p;
+    int ret;
+    void *cookie;
+};
+
+/**
+ * memtrack_async_reap
+ *
+ * Move up to n completed queries issued without a callback into results,
+ * oldest first.
+ *
+ * Returns the number of results filled.
+ */
+size_t memtrack_async_reap(struct memtrack_async_result *results, size_t n);
+
+/**
+ * memtrack_cache_configure
+ *
+ * Enable a process-wide cache of query results, keyed by process identity
+ * so a recycled pid never hits.  memtrack_proc_get and memtrack_proc_get_id
+ * return cached stats younger than ttl_ms instead of querying again.  Up to
+ * max_entries processes are cached, with max_entries rounded up to a power
+ * of two of at least 8.  Each process can only use one of the 8 slots that
+ * follow the slot its pid hashes to, so it may be evicted before the cache
+ * is full; the least recently used process of those slots goes first.
+ * Processes with more than 8 records of any memory type are never cached.
+ * max_entries or ttl_ms of 0 disables the cache, which is the default.
+ * Lookups never take a lock.
+ *
+ * May be called while other threads query, for example the watch and
+ * asynchronous query threads of the library; it waits for lookups already
+ * using the old cache to finish before freeing it.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_cache_configure(unsigned int ttl_ms, size_t max_entries);
+
+/**
+ * memtrack_limit_configure
+ *
+ * Limit the queries made to the backend by the process to calls_per_sec,
+ * with bursts of up to burst queries.  Queries over the limit wait, high
+ * priority ones first, except low priority ones which fail with -EAGAIN
+ * instead, and only use the upper half of the burst, so they are always
+ * shed with a burst of 1.  While the limit is
+ * enabled, concurrent queries for the same pid and memory type share one
+ * backend call.  calls_per_sec of 0 disables the limit, which is the
+ * default.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_limit_configure(unsigned int calls_per_sec, unsigned int burst);
+
+/**
+ * enum memtrack_priority
+ *
+ * Priority of the queries of a thread under memtrack_limit_configure.
+ */
+enum memtrack_priority {
+    MEMTRACK_PRIORITY_HIGH = 0,
+    MEMTRACK_PRIORITY_NORMAL = 1,
+    MEMTRACK_PRIORITY_LOW = 2,
+};
+
+/**
+ * memtrack_set_thread_priority
+ *
+ * Set the priority of the queries made by the calling thread.  The default
+ * is MEMTRACK_PRIORITY_NORMAL.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_set_thread_priority(enum memtrack_priority priority);
+
+/**
+ * memtrack_set_coalescing
+ *
+ * Enable or disable coalescing of concurrent queries.  When enabled, which
+ * is the default, a query for a pid and memory type that is already being
+ * made by another thread waits for that backend call and returns its result
+ * instead of making a call of its own.  If that call fails, the waiting
+ * queries make their own calls.  Queries always share calls while a limit
+ * set by memtrack_limit_configure is in effect, but only with queries of
+ * the same priority.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_set_coalescing(int enable);
+
+/**
+ * struct memtrack_cache_stats
+ *
+ * counters of the result cache since it was last configured.
+ */
+struct memtrack_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+/**
+ * memtrack_cache_get_stats
+ *
+ * Fill stats with the counters of the result cache.
+ */
+void memtrack_cache_get_stats(struct memtrack_cache_stats *stats);
+
 /**
  * memtrack_proc_graphics_total
  *
@@ -129,6 +621,660 @@ ssize_t memtrack_proc_other_total(struct memtrack_proc *p);
  */
 ssize_t memtrack_proc_other_pss(struct memtrack_proc *p);
 
+/**
+ * memtrack_proc_graphics_total_u64
+ * memtrack_proc_graphics_pss_u64
+ * memtrack_proc_gl_total_u64
+ * memtrack_proc_gl_pss_u64
+ * memtrack_proc_other_total_u64
+ * memtrack_proc_other_pss_u64
+ *
+ * Same as the accessors above, but store the size in bytes in *size as a
+ * 64-bit value on every ABI.  The ssize_t accessors fail with -EOVERFLOW if
+ * the size does not fit in ssize_t, as may happen on 32-bit builds; these
+ * only fail that way if the sum of the records does not fit in 64 bits, and
+ * then store UINT64_MAX.
+ *
+ * Returns 0 on success, -EOVERFLOW if the size saturated, -errno on error.
+ */
+int memtrack_proc_graphics_total_u64(struct memtrack_proc *p, uint64_t *size);
+int memtrack_proc_graphics_pss_u64(struct memtrack_proc *p, uint64_t *size);
+int memtrack_proc_gl_total_u64(struct memtrack_proc *p, uint64_t *size);
+int memtrack_proc_gl_pss_u64(struct memtrack_proc *p, uint64_t *size);
+int memtrack_proc_other_total_u64(struct memtrack_proc *p, uint64_t *size);
+int memtrack_proc_other_pss_u64(struct memtrack_proc *p, uint64_t *size);
+
+/**
+ * memtrack_proc_total_u64
+ *
+ * Store the total memory of the types in type_mask, a combination of
+ * MEMTRACK_TYPE_MASK values, in *size, saturating as the accessors above.
+ *
+ * Returns 0 on success, -EOVERFLOW if the size saturated, -errno on error.
+ */
+int memtrack_proc_total_u64(struct memtrack_proc *p, uint32_t type_mask, uint64_t *size);
+
+/**
+ * struct memtrack_watch
+ *
+ * a watch on the memory of one process, created with memtrack_watch_add and
+ * destroyed by memtrack_watch_remove.
+ */
+struct memtrack_watch;
+
+/**
+ * enum memtrack_watch_event
+ *
+ * MEMTRACK_WATCH_ABOVE: the size reached the threshold.
+ * MEMTRACK_WATCH_BELOW: the size dropped back below the threshold.
+ * MEMTRACK_WATCH_GONE: the process exited; the watch is no longer sampled.
+ */
+enum memtrack_watch_event {
+    MEMTRACK_WATCH_ABOVE = 0,
+    MEMTRACK_WATCH_BELOW = 1,
+    MEMTRACK_WATCH_GONE = 2,
+};
+
+/**
+ * memtrack_watch_callback
+ *
+ * Called on the library's watch thread with the watch, the event, the size
+ * that caused it and the cookie passed to memtrack_watch_add.  Callbacks of
+ * all watches run on the same thread, so they should return quickly.
+ */
+typedef void (*memtrack_watch_callback)(struct memtrack_watch *w,
+                                        enum memtrack_watch_event event, uint64_t size,
+                                        void *cookie);
+
+/**
+ * memtrack_watch_set_intervals
+ *
+ * Set the range of sampling intervals of all watches.  A watch is sampled
+ * every max_interval_ms while its size is far from the threshold, and more
+ * often as it gets closer, down to every min_interval_ms.  The defaults are
+ * 100 and 5000.  Watches are scheduled in 10ms ticks, and all watches due
+ * at a tick are sampled together, with one query per process.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_watch_set_intervals(unsigned int min_interval_ms, unsigned int max_interval_ms);
+
+/**
+ * memtrack_watch_add
+ *
+ * Watch the total memory of the types in type_mask used by the process
+ * named by id, and call cb each time it crosses threshold bytes in either
+ * direction.  A process already at the threshold is reported by the first
+ * sample.
+ *
+ * Returns NULL on error, with errno set.
+ */
+struct memtrack_watch *memtrack_watch_add(const struct memtrack_proc_id *id, uint32_t type_mask,
+                                          uint64_t threshold, memtrack_watch_callback cb,
+                                          void *cookie);
+
+/**
+ * memtrack_watch_remove
+ *
+ * Stop and free a watch.  Once this returns, cb is no longer running or
+ * going to be called for the watch, unless this is called from a watch
+ * callback, which is allowed.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_watch_remove(struct memtrack_watch *w);
+
+/**
+ * struct memtrack_device_info
+ *
+ * an opaque handle to device-wide graphics memory information.
+ * Created with memtrack_device_info_new, destroyed by
+ * memtrack_device_info_destroy.  Can be reused multiple times with
+ * memtrack_device_info_get.
+ */
+struct memtrack_device_info;
+
+/**
+ * memtrack_device_info_new
+ *
+ * Return a new handle to hold device-wide memory information.
+ *
+ * Returns NULL on error.
+ */
+struct memtrack_device_info *memtrack_device_info_new(void);
+
+/**
+ * memtrack_device_info_destroy
+ *
+ * Free all memory associated with a device info handle.
+ */
+void memtrack_device_info_destroy(struct memtrack_device_info *d);
+
+/**
+ * memtrack_device_info_set_ttl_ms
+ *
+ * Set how long device-wide information read by memtrack_device_info_get
+ * is reused before the underlying sources are read again.  The cache is
+ * shared by all handles in the process.  A ttl of 0 disables caching.
+ * The default is 1000ms.
+ */
+void memtrack_device_info_set_ttl_ms(unsigned int ttl_ms);
+
+/**
+ * memtrack_device_info_get
+ *
+ * Fill a device info handle with the list of GPU devices and the global
+ * memory counters.  Data younger than the configured ttl is served from
+ * the process-wide cache without touching the underlying sources.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_device_info_get(struct memtrack_device_info *d);
+
+/**
+ * memtrack_device_info_count
+ *
+ * Return the number of GPU devices in a filled device info handle.
+ */
+size_t memtrack_device_info_count(struct memtrack_device_info *d);
+
+/**
+ * memtrack_device_info_id
+ *
+ * Return the id (DRM minor) of the device at index i.
+ *
+ * Returns non-negative id on success, -errno on error.
+ */
+int memtrack_device_info_id(struct memtrack_device_info *d, size_t i);
+
+/**
+ * memtrack_device_info_name
+ *
+ * Return the driver name of the device at index i.  The string is owned
+ * by the handle and valid until the next memtrack_device_info_get.
+ *
+ * Returns NULL if i is out of range.
+ */
+const char *memtrack_device_info_name(struct memtrack_device_info *d, size_t i);
+
+/**
+ * memtrack_device_info_total
+ *
+ * Return the total amount of memory currently exported as dma-bufs on the
+ * device.  Subtracting the sum of memtrack_proc_graphics_total over all
+ * processes gives the memory not attributed to any process.
+ *
+ * Returns non-negative size in bytes on success, -errno on error.
+ * Returns -EOVERFLOW if the size does not fit in ssize_t.
+ */
+ssize_t memtrack_device_info_total(struct memtrack_device_info *d);
+
+/**
+ * memtrack_device_info_total_u64
+ *
+ * Same as memtrack_device_info_total, but store the size in bytes in *total
+ * as a 64-bit value on every ABI, saturating at UINT64_MAX.
+ *
+ * Returns 0 on success, -EOVERFLOW if the size saturated, -errno on error.
+ */
+int memtrack_device_info_total_u64(struct memtrack_device_info *d, uint64_t *total);
+
+/**
+ * memtrack_device_info_buffer_count
+ *
+ * Return the number of dma-bufs counted by memtrack_device_info_total.
+ *
+ * Returns non-negative count on success, -errno on error.
+ */
+ssize_t memtrack_device_info_buffer_count(struct memtrack_device_info *d);
+
+/**
+ * struct memtrack_snapshot_entry
+ *
+ * memory stats for a single process in a snapshot, in bytes.  The fields
+ * match the memtrack_proc_* accessors of the same name.  start_time is as in
+ * struct memtrack_proc_id, or 0 if the process exited before it was read.
+ */
+struct memtrack_snapshot_entry {
+    pid_t pid;
+    uint64_t start_time;
+    uint64_t graphics_total;
+    uint64_t graphics_pss;
+    uint64_t gl_total;
+    uint64_t gl_pss;
+    uint64_t other_total;
+    uint64_t other_pss;
+};
+
+/**
+ * struct memtrack_snapshot
+ *
+ * an opaque handle to the memory stats of every process on the system.
+ * Created with memtrack_snapshot_new, destroyed by memtrack_snapshot_destroy.
+ * Can be reused multiple times with memtrack_snapshot_take.
+ */
+struct memtrack_snapshot;
+
+/**
+ * memtrack_snapshot_new
+ *
+ * Return a new handle to hold a system memory snapshot.
+ *
+ * Returns NULL on error.
+ */
+struct memtrack_snapshot *memtrack_snapshot_new(void);
+
+/**
+ * memtrack_snapshot_destroy
+ *
+ * Free all memory associated with a snapshot handle.
+ */
+void memtrack_snapshot_destroy(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_take
+ *
+ * Fill a snapshot handle with the memory stats of every process in /proc.
+ * Processes that report no memory at all, or that exit while the snapshot
+ * is taken, are left out.  As with memtrack_proc_get, taking a snapshot on
+ * a handle that was used before should not require allocating new memory
+ * unless the number of processes grew.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_snapshot_take(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_time_ns
+ *
+ * Return the CLOCK_MONOTONIC time in nanoseconds at which the snapshot was
+ * taken, or 0 if the handle was never filled.
+ */
+uint64_t memtrack_snapshot_time_ns(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_count
+ *
+ * Return the number of process entries in a snapshot.
+ */
+size_t memtrack_snapshot_count(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_entries
+ *
+ * Return the process entries of a snapshot, sorted by pid.  The array is
+ * owned by the handle and valid until the handle is filled again.
+ */
+const struct memtrack_snapshot_entry *memtrack_snapshot_entries(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_find
+ *
+ * Look up the entry of the process named by id, for example to diff two
+ * snapshots.  An entry for the same pid but a different process is not
+ * returned.  If id->start_time is 0 only the pid is matched.
+ *
+ * Returns NULL if the process has no entry in the snapshot.
+ */
+const struct memtrack_snapshot_entry *memtrack_snapshot_find(struct memtrack_snapshot *s,
+        const struct memtrack_proc_id *id);
+
+/**
+ * Grouping flags for memtrack_snapshot_set_grouping.
+ *
+ * MEMTRACK_SNAPSHOT_GROUP_UID sums processes by the real uid in
+ * /proc/<pid>/status.  MEMTRACK_SNAPSHOT_GROUP_CGROUP sums processes by
+ * cpuset cgroup path (e.g. /foreground, /background) as read from
+ * /proc/<pid>/cgroup, or by the unified hierarchy path on cgroup v2 only
+ * devices.
+ */
+#define MEMTRACK_SNAPSHOT_GROUP_UID (1 << 0)
+#define MEMTRACK_SNAPSHOT_GROUP_CGROUP (1 << 1)
+
+/**
+ * struct memtrack_snapshot_group
+ *
+ * memory stats summed over the processes of a uid or cgroup, in bytes.  id
+ * is the uid for uid groups, and an index usable with
+ * memtrack_snapshot_cgroup_path for cgroup groups.
+ */
+struct memtrack_snapshot_group {
+    uint64_t id;
+    uint32_t nr_procs;
+    uint64_t graphics_total;
+    uint64_t graphics_pss;
+    uint64_t gl_total;
+    uint64_t gl_pss;
+    uint64_t other_total;
+    uint64_t other_pss;
+};
+
+/**
+ * memtrack_snapshot_set_grouping
+ *
+ * Select which groups memtrack_snapshot_take sums processes into, as a mask
+ * of MEMTRACK_SNAPSHOT_GROUP_* flags.  Groups are built in the same pass as
+ * the process entries.  A process whose pid is recycled before its uid and
+ * cgroup are read is left out of the groups.  The default is no grouping.
+ */
+void memtrack_snapshot_set_grouping(struct memtrack_snapshot *s, uint32_t flags);
+
+/**
+ * memtrack_snapshot_uid_count
+ *
+ * Return the number of uid groups in a snapshot.
+ */
+size_t memtrack_snapshot_uid_count(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_uids
+ *
+ * Return the uid groups of a snapshot, sorted by uid.  The array is owned
+ * by the handle and valid until the handle is filled again.
+ */
+const struct memtrack_snapshot_group *memtrack_snapshot_uids(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_cgroup_count
+ *
+ * Return the number of cgroup groups in a snapshot.
+ */
+size_t memtrack_snapshot_cgroup_count(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_cgroups
+ *
+ * Return the cgroup groups of a snapshot.  The array is owned by the
+ * handle and valid until the handle is filled again.
+ */
+const struct memtrack_snapshot_group *memtrack_snapshot_cgroups(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_cgroup_path
+ *
+ * Return the cgroup path of the cgroup group with the given id.  The string
+ * is owned by the handle and valid until the handle is filled again.
+ *
+ * Returns NULL if id is out of range.
+ */
+const char *memtrack_snapshot_cgroup_path(struct memtrack_snapshot *s, uint64_t id);
+
+/**
+ * memtrack_snapshot_set_zero_skip
+ *
+ * Make memtrack_snapshot_take query processes that keep reporting no memory
+ * less often.  Once a process has reported nothing on two sweeps in a row it
+ * is only queried every probe_every sweeps, until it reports memory again.
+ * Every full_every sweeps all processes are queried.  A process whose pid is
+ * recycled is always queried.  Since such processes have no entry either
+ * way, a process that starts using memory may be missing from up to
+ * probe_every - 1 snapshots.  probe_every of 0 disables skipping, which is
+ * the default; full_every of 0 disables full sweeps.
+ */
+void memtrack_snapshot_set_zero_skip(struct memtrack_snapshot *s, unsigned int probe_every,
+        unsigned int full_every);
+
+/**
+ * memtrack_snapshot_skipped
+ *
+ * Return the number of processes the last memtrack_snapshot_take did not
+ * query because they keep reporting no memory.
+ */
+size_t memtrack_snapshot_skipped(struct memtrack_snapshot *s);
+
+/**
+ * struct memtrack_snapshot_dmabuf
+ *
+ * dma-buf usage of a single process in a snapshot, in bytes.  rss counts
+ * every buffer the process holds or maps in full; pss divides each buffer by
+ * the number of processes sharing it.
+ */
+struct memtrack_snapshot_dmabuf {
+    pid_t pid;
+    uint64_t rss;
+    uint64_t pss;
+};
+
+/**
+ * memtrack_snapshot_set_dmabuf_index
+ *
+ * Enable or disable building a system-wide dma-buf index while taking a
+ * snapshot.  Each process is scanned once per sweep, including processes
+ * that memtrack_snapshot_set_zero_skip does not query.  Buffers are
+ * deduplicated by inode across all processes, which gives the device-wide
+ * unique dma-buf usage and the proportional share of every process.
+ * Disabled by default.
+ */
+void memtrack_snapshot_set_dmabuf_index(struct memtrack_snapshot *s, int enable);
+
+/**
+ * memtrack_snapshot_dmabuf_total
+ *
+ * Return the total size of the distinct dma-bufs held or mapped by any
+ * process, or 0 if the index was not built.
+ */
+uint64_t memtrack_snapshot_dmabuf_total(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_dmabuf_count
+ *
+ * Return the number of processes holding dma-bufs in a snapshot.
+ */
+size_t memtrack_snapshot_dmabuf_count(struct memtrack_snapshot *s);
+
+/**
+ * memtrack_snapshot_dmabufs
+ *
+ * Return the dma-buf usage of the processes holding dma-bufs, sorted by
+ * pid.  The sum of the pss fields equals memtrack_snapshot_dmabuf_total up
+ * to rounding.  The array is owned by the handle and valid until the handle
+ * is filled again.
+ */
+const struct memtrack_snapshot_dmabuf *memtrack_snapshot_dmabufs(struct memtrack_snapshot *s);
+
+/**
+ * MEMTRACK_SHM_DEFAULT_PATH
+ *
+ * Location at which memtrackd publishes its latest snapshot.
+ */
+#define MEMTRACK_SHM_DEFAULT_PATH "/dev/memtrackd/snapshot"
+
+/**
+ * struct memtrack_shm_writer
+ *
+ * an opaque handle to a shared memory region that snapshots are published
+ * to.  Only one writer may publish to a region at a time.
+ */
+struct memtrack_shm_writer;
+
+/**
+ * memtrack_shm_writer_create
+ *
+ * Create the file at path, or reuse an existing region in place, and map
+ * it as a region holding snapshots of at least max_entries processes.  An
+ * existing file is grown if needed but never shrunk, so that readers still
+ * mapping it don't fault; they remap it on their next read.
+ *
+ * Returns NULL on error, with errno set.
+ */
+struct memtrack_shm_writer *memtrack_shm_writer_create(const char *path, size_t max_entries);
+
+/**
+ * memtrack_shm_writer_destroy
+ *
+ * Unmap the region and free the writer.  The file is left in place.
+ */
+void memtrack_shm_writer_destroy(struct memtrack_shm_writer *w);
+
+/**
+ * memtrack_shm_publish
+ *
+ * Publish a snapshot to the region.  Readers never block the writer; a
+ * reader that races with publication retries its read.  Snapshots with more
+ * processes than the region holds are truncated.
+ *
+ * Returns 0 on success, -errno on error.
+ */
+int memtrack_shm_publish(struct memtrack_shm_writer *w, struct memtrack_snapshot *s);
+
+/**
+ * struct memtrack_shm_reader
+ *
+ * an opaque read-only mapping of a region published by memtrack_shm_writer.
+ */
+struct memtrack_shm_reader;
+
+/**
+ * memtrack_shm_reader_open
+ *
+ * Map the region at path for reading.
+ *
+ * Returns NULL on error, with errno set.
+ */
+struct memtrack_shm_reader *memtrack_shm_reader_open(const char *path);
+
+/**
+ * memtrack_shm_reader_close
+ *
+ * Unmap the region and free the reader.
+ */
+void memtrack_shm_reader_close(struct memtrack_shm_reader *r);
+
+/**
+ * memtrack_shm_read
+ *
+ * Copy the latest published snapshot into a snapshot handle without taking
+ * any lock and without calling into the memtrack HAL.
+ *
+ * Returns 0 on success, -EAGAIN if the writer kept the region busy for too
+ * long, -ENODATA if nothing has been published yet, -errno on other errors.
+ */
+int memtrack_shm_read(struct memtrack_shm_reader *r, struct memtrack_snapshot *s);
+
+/**
+ * struct memtrack_history
+ *
+ * an opaque handle to a fixed-size ring file that snapshots are appended
+ * to.  When the ring is full the oldest snapshots are dropped.  Records are
+ * compact: pids and sizes are delta-encoded and stored as varints.
+ */
+struct memtrack_history;
+
+/**
+ * memtrack_history_open
+ *
+ * Open the ring file at path for appending, creating it with room for size
+ * bytes of records if it does not exist or has a different size.  Records
+ * already in a matching file are kept.
+ *
+ * Returns NULL on error, with errno set.
+ */
+struct memtrack_history *memtrack_history_open(const char *path, size_t size);
+
+/**
+ * memtrack_history_close
+ *
+ * Unmap the ring file and free the handle.
+ */
+void memtrack_history_close(struct memtrack_history *h);
+
+/**
+ * memtrack_history_append
+ *
+ * Append a snapshot to the ring, dropping the oldest records as needed.
+ * Does not allocate memory.
+ *
+ * Returns 0 on success, -E2BIG if the snapshot can never fit in the ring,
+ * -errno on other errors.
+ */
+int memtrack_history_append(struct memtrack_history *h, struct memtrack_snapshot *s);
+
+/**
+ * struct memtrack_history_reader
+ *
+ * an opaque read-only cursor over the records of a ring file, oldest first.
+ * The ring should not be appended to while it is being read.
+ */
+struct memtrack_history_reader;
+
+/**
+ * memtrack_history_reader_open
+ *
+ * Open the ring file at path for reading.
+ *
+ * Returns NULL on error, with errno set.
+ */
+struct memtrack_history_reader *memtrack_history_reader_open(const char *path);
+
+/**
+ * memtrack_history_reader_close
+ *
+ * Unmap the ring file and free the reader.
+ */
+void memtrack_history_reader_close(struct memtrack_history_reader *r);
+
+/**
+ * memtrack_history_next
+ *
+ * Decode the next record of the ring into a snapshot handle.
+ *
+ * Returns 1 if a snapshot was read, 0 at the end of the ring, -errno on
+ * error.
+ */
+int memtrack_history_next(struct memtrack_history_reader *r, struct memtrack_snapshot *s);
+
+/**
+ * struct memtrack_psi_trigger
+ *
+ * an opaque handle to a memory pressure trigger, for sampling when the
+ * system is under memory pressure rather than on a fixed timer.  Created
+ * with memtrack_psi_trigger_new, destroyed by memtrack_psi_trigger_destroy.
+ */
+struct memtrack_psi_trigger;
+
+/**
+ * memtrack_psi_trigger_new
+ *
+ * Arm a trigger on /proc/pressure/memory that fires when some task (or,
+ * with full set, every task) stalled on memory for stall_ms within a
+ * window of window_ms.  window_ms must be between 500 and 10000, and a
+ * multiple of 2000 in processes without CAP_SYS_RESOURCE.
+ * memtrack_psi_trigger_wait returns at most once per min_interval_ms.
+ *
+ * Returns NULL on error, with errno set.
+ */
+struct memtrack_psi_trigger *memtrack_psi_trigger_new(unsigned int stall_ms,
+                                                      unsigned int window_ms, int full,
+                                                      unsigned int min_interval_ms);
+
+/**
+ * memtrack_psi_trigger_destroy
+ *
+ * Disarm the trigger and free the handle.
+ */
+void memtrack_psi_trigger_destroy(struct memtrack_psi_trigger *t);
+
+/**
+ * memtrack_psi_trigger_fd
+ *
+ * Return the fd of the trigger, which polls POLLPRI when it fires, for use
+ * in an existing event loop instead of memtrack_psi_trigger_wait.
+ *
+ * Returns the fd on success, -errno on error.
+ */
+int memtrack_psi_trigger_fd(struct memtrack_psi_trigger *t);
+
+/**
+ * memtrack_psi_trigger_wait
+ *
+ * Wait up to timeout_ms, or forever if timeout_ms is negative, for the
+ * trigger to fire.  If it fires sooner than min_interval_ms after the last
+ * time this returned 1, wait until then.
+ *
+ * Returns 1 if the trigger fired, 0 on timeout, -errno on error.
+ */
+int memtrack_psi_trigger_wait(struct memtrack_psi_trigger *t, int timeout_ms);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,40 +18,36 @@
 #include <memtrack/memtrack.h>
 
 #include <errno.h>
+#include <limits.h>
 #include <malloc.h>
+#include <signal.h>
 #include <vector>
 #include <string.h>
+#include <atomic>
+#include <iterator>
 #include <mutex>
 
 #include <log/log.h>
 
+#include "memtrack_internal.h"
+
 using android::hardware::memtrack::V1_0::IMemtrack;
-using android::hardware::memtrack::V1_0::MemtrackType;
-using android::hardware::memtrack::V1_0::MemtrackRecord;
-using android::hardware::memtrack::V1_0::MemtrackFlag;
 using android::hardware::memtrack::V1_0::MemtrackStatus;
 using android::hardware::hidl_vec;
 using android::hardware::Return;
 
-struct memtrack_proc_type {
-    MemtrackType type;
-    std::vector<MemtrackRecord> records;
-};
-
-struct memtrack_proc {
-    pid_t pid;
-    memtrack_proc_type types[static_cast<int>(MemtrackType::NUM_TYPES)];
-};
-
 //TODO(b/31632518)
 static android::sp<IMemtrack> get_instance() {
-    static android::sp<IMemtrack> module = IMemtrack::getService();
+    // Leaked, like the backends, for queries still running on library
+    // threads at exit.
+    static android::sp<IMemtrack>* const module =
+            new android::sp<IMemtrack>(IMemtrack::getService());
     static bool logged = false;
-    if (module == nullptr && !logged) {
+    if (*module == nullptr && !logged) {
         logged = true;
         ALOGE("Couldn't load memtrack module");
     }
-    return module;
+    return *module;
 }
 
 memtrack_proc *memtrack_proc_new(void)
@@ -64,27 +60,147 @@ void memtrack_proc_destroy(memtrack_proc *p)
     delete(p);
 }
 
+class HalBackend : public MemtrackBackend {
+  public:
+    int getMemory(pid_t pid, MemtrackType type,
+            std::vector<MemtrackRecord> *records) override
+    {
+        int err = 0;
+        android::sp<IMemtrack> memtrack = get_instance();
+        if (memtrack == nullptr)
+            return -1;
+
+        Return<void> ret = memtrack->getMemory(pid, type,
+            [&records, &err](MemtrackStatus status, hidl_vec<MemtrackRecord> r) {
+                if (status != MemtrackStatus::SUCCESS) {
+                    err = -1;
+                    records->resize(0);
+                }
+                records->resize(r.size());
+                for (size_t i = 0; i < r.size(); i++) {
+                    (*records)[i].sizeInBytes = r[i].sizeInBytes;
+                    (*records)[i].flags = r[i].flags;
+                }
+        });
+        return ret.isOk() ? err : -1;
+    }
+};
+
+/* dma-bufs for graphics memory and DRM clients for GL memory */
+class KernelBackend : public MemtrackBackend {
+  public:
+    KernelBackend(MemtrackBackend *dmabuf, MemtrackBackend *drm)
+        : dmabuf_(dmabuf), drm_(drm) {}
+
+    int getMemory(pid_t pid, MemtrackType type,
+            std::vector<MemtrackRecord> *records) override
+    {
+        if (type == MemtrackType::GL)
+            return drm_->getMemory(pid, type, records);
+        return dmabuf_->getMemory(pid, type, records);
+    }
+
+  private:
+    MemtrackBackend *dmabuf_;
+    MemtrackBackend *drm_;
+};
+
+static std::atomic<int> backend_choice{MEMTRACK_BACKEND_AUTO};
+static std::atomic<uint64_t> backend_calls{0};
+
+/*
+ * The backends are intentionally leaked: the async workers and the watch
+ * scheduler are detached and may still be querying them at exit.
+ */
+static MemtrackBackend *get_backend()
+{
+    static HalBackend *const hal = new HalBackend();
+    static MemtrackBackend *const dmabuf =
+            memtrack_create_dmabuf_backend("/proc").release();
+    static MemtrackBackend *const drm =
+            memtrack_create_drm_backend("/proc").release();
+    static KernelBackend *const kernel = new KernelBackend(dmabuf, drm);
+    static bool logged = false;
+
+    switch (backend_choice.load(std::memory_order_relaxed)) {
+    case MEMTRACK_BACKEND_HAL:
+        return hal;
+    case MEMTRACK_BACKEND_DMABUF:
+        return dmabuf;
+    case MEMTRACK_BACKEND_DRM:
+        return drm;
+    case MEMTRACK_BACKEND_KERNEL:
+        return kernel;
+    case MEMTRACK_BACKEND_REPLAY:
+        return memtrack_replay_backend();
+    default:
+        if (get_instance() != nullptr)
+            return hal;
+        if (!logged) {
+            logged = true;
+            ALOGI("Falling back to kernel memory tracking");
+        }
+        return kernel;
+    }
+}
+
+int memtrack_set_backend(memtrack_backend backend)
+{
+    switch (backend) {
+    case MEMTRACK_BACKEND_AUTO:
+    case MEMTRACK_BACKEND_HAL:
+    case MEMTRACK_BACKEND_DMABUF:
+    case MEMTRACK_BACKEND_DRM:
+    case MEMTRACK_BACKEND_KERNEL:
+        backend_choice.store(backend, std::memory_order_relaxed);
+        return 0;
+    case MEMTRACK_BACKEND_REPLAY:
+        if (memtrack_replay_backend() == nullptr)
+            return -ENODATA;
+        backend_choice.store(backend, std::memory_order_relaxed);
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+uint64_t memtrack_backend_calls(void)
+{
+    return backend_calls.load(std::memory_order_relaxed);
+}
+
+bool memtrack_replaying()
+{
+    return backend_choice.load(std::memory_order_relaxed) ==
+            MEMTRACK_BACKEND_REPLAY;
+}
+
+static int backend_get_memory(pid_t pid, MemtrackType type,
+        std::vector<MemtrackRecord> *records)
+{
+    if (memtrack_limit_enabled()) {
+        int ret = memtrack_limit_acquire();
+        if (ret != 0)
+            return ret;
+    }
+
+    backend_calls.fetch_add(1, std::memory_order_relaxed);
+    if (!memtrack_recording())
+        return get_backend()->getMemory(pid, type, records);
+
+    uint64_t start = memtrack_now_ns();
+    int ret = get_backend()->getMemory(pid, type, records);
+    memtrack_record(pid, type, ret, *records, memtrack_now_ns() - start);
+    return ret;
+}
+
 static int memtrack_proc_get_type(memtrack_proc_type *t,
         pid_t pid, MemtrackType type)
 {
-    int err = 0;
-    android::sp<IMemtrack> memtrack = get_instance();
-    if (memtrack == nullptr)
-        return -1;
-
-    Return<void> ret = memtrack->getMemory(pid, type,
-        [&t, &err](MemtrackStatus status, hidl_vec<MemtrackRecord> records) {
-            if (status != MemtrackStatus::SUCCESS) {
-                err = -1;
-                t->records.resize(0);
-            }
-            t->records.resize(records.size());
-            for (size_t i = 0; i < records.size(); i++) {
-                t->records[i].sizeInBytes = records[i].sizeInBytes;
-                t->records[i].flags = records[i].flags;
-            }
-    });
-    return ret.isOk() ? err : -1;
+    /* callers held back by the limiter always share the calls they wait for */
+    if (memtrack_coalescing_enabled() || memtrack_limit_enabled())
+        return memtrack_coalesce(pid, type, &t->records, backend_get_memory);
+    return backend_get_memory(pid, type, &t->records);
 }
 
 /* TODO: sanity checks on return values from HALs:
@@ -99,77 +215,362 @@ static int memtrack_proc_sanity_check(memtrack_proc* /*p*/)
     return 0;
 }
 
+static_assert(MEMTRACK_TYPE_OTHER == (int)MemtrackType::OTHER &&
+        MEMTRACK_TYPE_GL == (int)MemtrackType::GL &&
+        MEMTRACK_TYPE_GRAPHICS == (int)MemtrackType::GRAPHICS &&
+        MEMTRACK_TYPE_MULTIMEDIA == (int)MemtrackType::MULTIMEDIA &&
+        MEMTRACK_TYPE_CAMERA == (int)MemtrackType::CAMERA &&
+        MEMTRACK_NUM_TYPES == (int)MemtrackType::NUM_TYPES,
+        "memtrack_type must match MemtrackType");
+
+/*
+ * Fill p with the stats of pid, from the result cache when it holds fresh
+ * stats for the same process.  start_time is 0 when the identity of the
+ * process is unknown, in which case the cache is bypassed.
+ *
+ * Only the types in type_mask are queried.  Unless partial is set, the first
+ * type that fails ends the query and is returned.  With partial set every
+ * type is queried, and the query only fails if they all do.  Either way each
+ * type's status is kept in p, and types that were not queried are marked
+ * -ENODATA.
+ */
+static int memtrack_proc_fetch(memtrack_proc *p, pid_t pid,
+        uint64_t start_time, uint32_t type_mask, bool partial)
+{
+    p->pid = pid;
+    p->start_time = 0;
+
+    if (start_time && memtrack_cache_lookup(pid, start_time, p)) {
+        /* the cache holds every type; only report the requested ones */
+        for (uint32_t i = 0; i < (uint32_t)MemtrackType::NUM_TYPES; i++) {
+            memtrack_proc_type *t = &p->types[i];
+            if (type_mask & (1u << i)) {
+                t->status = 0;
+            } else {
+                t->status = -ENODATA;
+                t->records.clear();
+            }
+        }
+        return 0;
+    }
+
+    int err = 0;
+    bool any = false;
+    for (uint32_t i = 0; i < (uint32_t)MemtrackType::NUM_TYPES; i++) {
+        memtrack_proc_type *t = &p->types[i];
+        if (!(type_mask & (1u << i)) || (err != 0 && !partial)) {
+            t->status = -ENODATA;
+            t->records.clear();
+            continue;
+        }
+
+        t->status = memtrack_proc_get_type(t, pid, (MemtrackType)i);
+        if (t->status != 0) {
+            t->records.clear();
+            if (err == 0)
+                err = t->status;
+        } else {
+            any = true;
+        }
+    }
+    if (!partial && err != 0)
+        return err;
+    if (!any)
+        return err;
+
+    int ret = memtrack_proc_sanity_check(p);
+    if (ret == 0 && start_time &&
+            memtrack_proc_valid_types(p) == MEMTRACK_TYPE_MASK_ALL)
+        memtrack_cache_insert(pid, start_time, p);
+    return ret;
+}
+
 int memtrack_proc_get(memtrack_proc *p, pid_t pid)
 {
     if (!p) {
         return -EINVAL;
     }
 
-    p->pid = pid;
+    /* only pay for reading the identity when it can save HAL calls */
+    uint64_t start_time = 0;
+    if (memtrack_cache_enabled() &&
+            memtrack_read_start_time(pid, &start_time) < 0) {
+        start_time = 0;
+    }
+
+    return memtrack_proc_fetch(p, pid, start_time, MEMTRACK_TYPE_MASK_ALL,
+            false);
+}
+
+int memtrack_proc_get_types(memtrack_proc *p, pid_t pid, uint32_t type_mask)
+{
+    if (!p || !type_mask || (type_mask & ~MEMTRACK_TYPE_MASK_ALL)) {
+        return -EINVAL;
+    }
+
+    uint64_t start_time = 0;
+    if (memtrack_cache_enabled() &&
+            memtrack_read_start_time(pid, &start_time) < 0) {
+        start_time = 0;
+    }
+
+    return memtrack_proc_fetch(p, pid, start_time, type_mask, false);
+}
+
+int memtrack_proc_get_partial(memtrack_proc *p, pid_t pid)
+{
+    if (!p) {
+        return -EINVAL;
+    }
+
+    uint64_t start_time = 0;
+    if (memtrack_cache_enabled() &&
+            memtrack_read_start_time(pid, &start_time) < 0) {
+        start_time = 0;
+    }
+
+    return memtrack_proc_fetch(p, pid, start_time, MEMTRACK_TYPE_MASK_ALL,
+            true);
+}
+
+int memtrack_proc_type_status(memtrack_proc *p, memtrack_type type)
+{
+    if (!p || type < 0 || type >= MEMTRACK_NUM_TYPES) {
+        return -EINVAL;
+    }
+
+    return p->types[type].status;
+}
+
+uint32_t memtrack_proc_valid_types(memtrack_proc *p)
+{
+    uint32_t mask = 0;
+
+    if (!p)
+        return 0;
+
     for (uint32_t i = 0; i < (uint32_t)MemtrackType::NUM_TYPES; i++) {
-        int ret = memtrack_proc_get_type(&p->types[i], pid, (MemtrackType)i);
-        if (ret != 0)
-           return ret;
+        if (p->types[i].status == 0)
+            mask |= 1u << i;
+    }
+    return mask;
+}
+
+int memtrack_proc_id_get(pid_t pid, memtrack_proc_id *id)
+{
+    if (!id) {
+        return -EINVAL;
+    }
+
+    id->pid = pid;
+    int ret = memtrack_read_start_time(pid, &id->start_time);
+    if (ret < 0)
+        id->start_time = 0;
+    return ret;
+}
+
+int memtrack_proc_id_alive(const memtrack_proc_id *id)
+{
+    if (!id) {
+        return -EINVAL;
+    }
+
+    /*
+     * A start time of 0 means it could not be read when the id was made.
+     * Only the pid can be checked then.
+     */
+    if (id->start_time == 0) {
+        if (kill(id->pid, 0) == 0 || errno == EPERM)
+            return 1;
+        return errno == ESRCH ? 0 : -errno;
+    }
+
+    uint64_t start_time;
+    int ret = memtrack_read_start_time(id->pid, &start_time);
+    if (ret == -ENOENT || ret == -ESRCH) {
+        return 0;
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    return start_time == id->start_time;
+}
+
+int memtrack_proc_get_id(memtrack_proc *p, const memtrack_proc_id *id)
+{
+    if (!p || !id) {
+        return -EINVAL;
+    }
+
+    int ret = memtrack_proc_id_alive(id);
+    if (ret <= 0)
+        return ret ? ret : -ESRCH;
+
+    ret = memtrack_proc_fetch(p, id->pid, id->start_time,
+            MEMTRACK_TYPE_MASK_ALL, false);
+    if (ret != 0)
+        return ret;
+
+    /* the pid may have been recycled while the HAL was being queried */
+    ret = memtrack_proc_id_alive(id);
+    if (ret <= 0)
+        return ret ? ret : -ESRCH;
+
+    p->start_time = id->start_time;
+    return 0;
+}
+
+int memtrack_proc_identity(memtrack_proc *p, memtrack_proc_id *id)
+{
+    if (!p || !id) {
+        return -EINVAL;
     }
 
-    return memtrack_proc_sanity_check(p);
+    id->pid = p->pid;
+    id->start_time = p->start_time;
+    return 0;
 }
 
-static ssize_t memtrack_proc_sum(memtrack_proc *p,
-        const std::vector<MemtrackType>& types, uint32_t flags)
+/*
+ * Sum the records of types with all of flags set into *sum, saturating at
+ * UINT64_MAX.  Returns 0, -EOVERFLOW if the sum saturated, or the status of
+ * the first type that failed.
+ */
+static int memtrack_proc_sum(memtrack_proc *p, const MemtrackType *types,
+        size_t ntypes, uint32_t flags, uint64_t *sum)
 {
-    ssize_t sum = 0;
+    *sum = 0;
+
+    for (size_t i = 0; i < ntypes; i++) {
+        if (p->types[static_cast<int>(types[i])].status != 0)
+            return p->types[static_cast<int>(types[i])].status;
+    }
 
-    for (size_t i = 0; i < types.size(); i++) {
-        memtrack_proc_type type = p->types[static_cast<int>(types[i])];
-        std::vector<MemtrackRecord> records = type.records;
+    for (size_t i = 0; i < ntypes; i++) {
+        const std::vector<MemtrackRecord>& records =
+                p->types[static_cast<int>(types[i])].records;
         for (size_t j = 0; j < records.size(); j++) {
-            if ((records[j].flags & flags) == flags) {
-                sum += records[j].sizeInBytes;
+            if ((records[j].flags & flags) == flags &&
+                    __builtin_add_overflow(*sum, records[j].sizeInBytes, sum)) {
+                *sum = UINT64_MAX;
+                return -EOVERFLOW;
             }
         }
     }
 
+    return 0;
+}
+
+static ssize_t memtrack_proc_sum_ssize(memtrack_proc *p,
+        const MemtrackType *types, size_t ntypes, uint32_t flags)
+{
+    uint64_t sum;
+    int ret = memtrack_proc_sum(p, types, ntypes, flags, &sum);
+    if (ret != 0)
+        return ret;
+    if (sum > SSIZE_MAX)
+        return -EOVERFLOW;
     return sum;
 }
 
+static const MemtrackType graphics_types[] = { MemtrackType::GRAPHICS };
+static const MemtrackType gl_types[] = { MemtrackType::GL };
+static const MemtrackType other_types[] = { MemtrackType::MULTIMEDIA,
+        MemtrackType::CAMERA, MemtrackType::OTHER };
+
+#define MEMTRACK_PSS_FLAGS ((uint32_t)MemtrackFlag::SMAPS_UNACCOUNTED)
+
 ssize_t memtrack_proc_graphics_total(memtrack_proc *p)
 {
-    std::vector<MemtrackType> types = {MemtrackType::GRAPHICS};
-    return memtrack_proc_sum(p, types, 0);
+    return memtrack_proc_sum_ssize(p, graphics_types,
+            std::size(graphics_types), 0);
 }
 
 ssize_t memtrack_proc_graphics_pss(memtrack_proc *p)
 {
-    std::vector<MemtrackType> types = { MemtrackType::GRAPHICS };
-    return memtrack_proc_sum(p, types,
-            (uint32_t)MemtrackFlag::SMAPS_UNACCOUNTED);
+    return memtrack_proc_sum_ssize(p, graphics_types,
+            std::size(graphics_types), MEMTRACK_PSS_FLAGS);
 }
 
 ssize_t memtrack_proc_gl_total(memtrack_proc *p)
 {
-    std::vector<MemtrackType> types = { MemtrackType::GL };
-    return memtrack_proc_sum(p, types, 0);
+    return memtrack_proc_sum_ssize(p, gl_types, std::size(gl_types), 0);
 }
 
 ssize_t memtrack_proc_gl_pss(memtrack_proc *p)
 {
-    std::vector<MemtrackType> types = { MemtrackType::GL };
-    return memtrack_proc_sum(p, types,
-            (uint32_t)MemtrackFlag::SMAPS_UNACCOUNTED);
+    return memtrack_proc_sum_ssize(p, gl_types, std::size(gl_types),
+            MEMTRACK_PSS_FLAGS);
 }
 
 ssize_t memtrack_proc_other_total(memtrack_proc *p)
 {
-    std::vector<MemtrackType> types = { MemtrackType::MULTIMEDIA,
-            MemtrackType::CAMERA, MemtrackType::OTHER };
-    return memtrack_proc_sum(p, types, 0);
+    return memtrack_proc_sum_ssize(p, other_types, std::size(other_types), 0);
 }
 
 ssize_t memtrack_proc_other_pss(memtrack_proc *p)
 {
-    std::vector<MemtrackType> types = { MemtrackType::MULTIMEDIA,
-            MemtrackType::CAMERA, MemtrackType::OTHER };
-    return memtrack_proc_sum(p, types,
-            (uint32_t)MemtrackFlag::SMAPS_UNACCOUNTED);
+    return memtrack_proc_sum_ssize(p, other_types, std::size(other_types),
+            MEMTRACK_PSS_FLAGS);
+}
+
+int memtrack_proc_graphics_total_u64(memtrack_proc *p, uint64_t *size)
+{
+    if (!p || !size)
+        return -EINVAL;
+    return memtrack_proc_sum(p, graphics_types, std::size(graphics_types), 0,
+            size);
+}
+
+int memtrack_proc_graphics_pss_u64(memtrack_proc *p, uint64_t *size)
+{
+    if (!p || !size)
+        return -EINVAL;
+    return memtrack_proc_sum(p, graphics_types, std::size(graphics_types),
+            MEMTRACK_PSS_FLAGS, size);
+}
+
+int memtrack_proc_gl_total_u64(memtrack_proc *p, uint64_t *size)
+{
+    if (!p || !size)
+        return -EINVAL;
+    return memtrack_proc_sum(p, gl_types, std::size(gl_types), 0, size);
+}
+
+int memtrack_proc_gl_pss_u64(memtrack_proc *p, uint64_t *size)
+{
+    if (!p || !size)
+        return -EINVAL;
+    return memtrack_proc_sum(p, gl_types, std::size(gl_types),
+            MEMTRACK_PSS_FLAGS, size);
+}
+
+int memtrack_proc_other_total_u64(memtrack_proc *p, uint64_t *size)
+{
+    if (!p || !size)
+        return -EINVAL;
+    return memtrack_proc_sum(p, other_types, std::size(other_types), 0, size);
+}
+
+int memtrack_proc_other_pss_u64(memtrack_proc *p, uint64_t *size)
+{
+    if (!p || !size)
+        return -EINVAL;
+    return memtrack_proc_sum(p, other_types, std::size(other_types),
+            MEMTRACK_PSS_FLAGS, size);
+}
+
+int memtrack_proc_total_u64(memtrack_proc *p, uint32_t type_mask,
+        uint64_t *size)
+{
+    if (!p || !size || !type_mask || (type_mask & ~MEMTRACK_TYPE_MASK_ALL))
+        return -EINVAL;
+
+    MemtrackType types[MEMTRACK_NUM_TYPES];
+    size_t ntypes = 0;
+    for (int i = 0; i < MEMTRACK_NUM_TYPES; i++) {
+        if (type_mask & MEMTRACK_TYPE_MASK(i))
+            types[ntypes++] = (MemtrackType)i;
+    }
+    return memtrack_proc_sum(p, types, ntypes, 0, size);
 }
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <android-base/unique_fd.h>
+
+/*
+ * Asynchronous queries run memtrack_proc_get on a small pool of worker
+ * threads.  The pool is started by the first query and lives until the
+ * process exits.  Every accepted query counts against max_in_flight until
+ * its callback returns or, without a callback, until it is reaped, which
+ * bounds both the request and the completion queues.
+ */
+namespace {
+
+struct AsyncRequest {
+    memtrack_proc* p;
+    pid_t pid;
+    memtrack_proc_callback cb;
+    void* cookie;
+};
+
+struct AsyncPool {
+    std::mutex lock;
+    std::condition_variable cv;
+    unsigned int threads = 2;
+    size_t max_in_flight = 256;
+    size_t in_flight = 0;
+    bool started = false;
+    std::deque<AsyncRequest> requests;
+    std::deque<memtrack_async_result> completions;
+    ::android::base::unique_fd event_fd;
+};
+
+}  // namespace
+
+/* Intentionally leaked: detached workers may still use it at exit. */
+static AsyncPool* const pool = new AsyncPool();
+
+static void worker() {
+    std::unique_lock<std::mutex> lock(pool->lock);
+    for (;;) {
+        pool->cv.wait(lock, [] { return !pool->requests.empty(); });
+        AsyncRequest req = pool->requests.front();
+        pool->requests.pop_front();
+        lock.unlock();
+
+        int ret = memtrack_proc_get(req.p, req.pid);
+        if (req.cb) {
+            req.cb(req.p, ret, req.cookie);
+        }
+
+        lock.lock();
+        if (req.cb) {
+            pool->in_flight--;
+        } else {
+            pool->completions.push_back({req.p, ret, req.cookie});
+            if (pool->event_fd >= 0) {
+                eventfd_write(pool->event_fd, 1);
+            }
+        }
+    }
+}
+
+/* Must be called with pool->lock held. */
+static int ensure_event_fd() {
+    if (pool->event_fd < 0) {
+        pool->event_fd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+        if (pool->event_fd < 0) {
+            return -errno;
+        }
+        // Completions that arrived before the fd existed still need a wakeup.
+        if (!pool->completions.empty()) {
+            eventfd_write(pool->event_fd, 1);
+        }
+    }
+    return pool->event_fd;
+}
+
+int memtrack_async_configure(unsigned int threads, size_t max_in_flight) {
+    if (threads == 0 || max_in_flight == 0) {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(pool->lock);
+    if (pool->started) {
+        return -EBUSY;
+    }
+    pool->threads = threads;
+    pool->max_in_flight = max_in_flight;
+    return 0;
+}
+
+int memtrack_proc_get_async(memtrack_proc* p, pid_t pid, memtrack_proc_callback cb,
+                            void* cookie) {
+    if (!p) {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(pool->lock);
+    if (pool->in_flight >= pool->max_in_flight) {
+        return -EAGAIN;
+    }
+    if (!pool->started) {
+        for (unsigned int i = 0; i < pool->threads; i++) {
+            std::thread(worker).detach();
+        }
+        pool->started = true;
+    }
+
+    pool->requests.push_back({p, pid, cb, cookie});
+    pool->in_flight++;
+    pool->cv.notify_one();
+    return 0;
+}
+
+int memtrack_async_eventfd(void) {
+    std::lock_guard<std::mutex> lock(pool->lock);
+    return ensure_event_fd();
+}
+
+size_t memtrack_async_reap(memtrack_async_result* results, size_t n) {
+    if (!results) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(pool->lock);
+    if (pool->event_fd >= 0) {
+        eventfd_t unused;
+        eventfd_read(pool->event_fd, &unused);
+    }
+
+    size_t count = 0;
+    while (count < n && !pool->completions.empty()) {
+        results[count++] = pool->completions.front();
+        pool->completions.pop_front();
+    }
+    pool->in_flight -= count;
+
+    // Leave the fd readable while results remain so level-triggered pollers
+    // come back for them.
+    if (!pool->completions.empty() && pool->event_fd >= 0) {
+        eventfd_write(pool->event_fd, 1);
+    }
+    return count;
+}
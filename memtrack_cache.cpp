@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+
+/*
+ * The cache is a fixed array of slots.  A process may live in any of the
+ * kProbeSlots slots following the one its pid hashes to, which bounds both
+ * lookups and evictions.
+ *
+ * Each slot is protected by a sequence lock: inserts, serialized by a mutex,
+ * make seq odd while they rewrite the slot, and lookups copy the slot out and
+ * retry if seq changed meanwhile.  Lookups never wait; a slot that is being
+ * written is simply treated as a miss.
+ *
+ * Eviction approximates LRU with the CLOCK algorithm: a hit sets the slot's
+ * referenced bit, and an insert into a full window takes the first slot
+ * without the bit, clearing the bits of the slots it passes over.
+ *
+ * The table has max_entries slots rounded up to a power of two, and at
+ * least kProbeSlots.  Only processes with at most kMaxRecords records of
+ * each type are cached, which keeps slots fixed-size; the header documents
+ * both limits.
+ *
+ * Reconfiguring replaces the whole cache while lookups may be using it.
+ * Lookups count themselves in one of two counters, picked by the parity of
+ * an epoch, before loading the cache pointer.  Reconfiguring swaps the
+ * pointer, flips the epoch and waits for the counter of the old epoch to
+ * drain before freeing the old cache.  Lookups that start later use the
+ * other counter and can only see the new cache, so the wait is bounded by
+ * the lookups already in progress.
+ */
+static constexpr size_t kProbeSlots = 8;
+static constexpr size_t kMaxRecords = 8;
+static constexpr int kLookupRetries = 3;
+static constexpr size_t kNumTypes = static_cast<size_t>(MemtrackType::NUM_TYPES);
+
+namespace {
+
+struct CacheSlot {
+    std::atomic<uint32_t> seq;
+    std::atomic<bool> referenced;
+    pid_t pid;
+    uint64_t start_time;
+    uint64_t time_ns;
+    uint8_t counts[kNumTypes];
+    MemtrackRecord records[kNumTypes][kMaxRecords];
+};
+
+struct Cache {
+    uint64_t ttl_ns;
+    size_t mask;
+    std::unique_ptr<CacheSlot[]> slots;
+};
+
+}  // namespace
+
+/*
+ * The configured cache and the insert lock are never destroyed: detached
+ * library threads may still be querying when the process exits.
+ */
+static Cache* cache;
+static std::atomic<Cache*> active_cache{nullptr};
+static std::mutex* const insert_lock = new std::mutex();
+static std::atomic<uint32_t> lookup_epoch;
+static std::atomic<uint32_t> lookups[2];
+
+static std::atomic<uint64_t> hits;
+static std::atomic<uint64_t> misses;
+static std::atomic<uint64_t> evictions;
+
+static size_t home_slot(const Cache* c, pid_t pid) {
+    return (static_cast<uint64_t>(pid) * 0x9e3779b97f4a7c15ULL >> 32) & c->mask;
+}
+
+/* Make c the cache used by lookups, and free the old one once unused. */
+static void replace_cache(std::unique_ptr<Cache> c) {
+    active_cache.store(c.get(), std::memory_order_seq_cst);
+    uint32_t old_epoch = lookup_epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+    while (lookups[old_epoch].load(std::memory_order_seq_cst) != 0) {
+        sched_yield();
+    }
+    delete cache;
+    cache = c.release();
+}
+
+int memtrack_cache_configure(unsigned int ttl_ms, size_t max_entries) {
+    std::lock_guard<std::mutex> lock(*insert_lock);
+
+    std::unique_ptr<Cache> c;
+    if (ttl_ms != 0 && max_entries != 0) {
+        size_t capacity = kProbeSlots;
+        while (capacity < max_entries) {
+            if (capacity > SIZE_MAX / 2) {
+                return -EINVAL;
+            }
+            capacity *= 2;
+        }
+
+        c = std::make_unique<Cache>();
+        c->ttl_ns = static_cast<uint64_t>(ttl_ms) * 1000000ULL;
+        c->mask = capacity - 1;
+        c->slots.reset(new (std::nothrow) CacheSlot[capacity]());
+        if (!c->slots) {
+            return -ENOMEM;
+        }
+    }
+
+    replace_cache(std::move(c));
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+    return 0;
+}
+
+void memtrack_cache_get_stats(memtrack_cache_stats* stats) {
+    if (stats) {
+        stats->hits = hits.load(std::memory_order_relaxed);
+        stats->misses = misses.load(std::memory_order_relaxed);
+        stats->evictions = evictions.load(std::memory_order_relaxed);
+    }
+}
+
+bool memtrack_cache_enabled() {
+    return active_cache.load(std::memory_order_acquire) != nullptr;
+}
+
+static bool lookup_slot(const Cache* c, CacheSlot* slot, pid_t pid, uint64_t start_time,
+                        uint64_t now, memtrack_proc* p) {
+    for (int i = 0; i < kLookupRetries; i++) {
+        uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            return false;
+        }
+        if (slot->pid != pid || slot->start_time != start_time ||
+            now - slot->time_ns >= c->ttl_ns) {
+            // A mismatch read while an insert races is at worst a spurious
+            // miss, so it needs no validation.
+            return false;
+        }
+
+        uint8_t counts[kNumTypes];
+        memcpy(counts, slot->counts, sizeof(counts));
+        for (size_t t = 0; t < kNumTypes; t++) {
+            size_t n = std::min<size_t>(counts[t], kMaxRecords);
+            p->types[t].records.assign(slot->records[t], slot->records[t] + n);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) == seq) {
+            slot->referenced.store(true, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool lookup(const Cache* c, pid_t pid, uint64_t start_time, memtrack_proc* p) {
+    uint64_t now = memtrack_now_ns();
+    size_t home = home_slot(c, pid);
+    for (size_t i = 0; i < kProbeSlots; i++) {
+        if (lookup_slot(c, &c->slots[(home + i) & c->mask], pid, start_time, now, p)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool memtrack_cache_lookup(pid_t pid, uint64_t start_time, memtrack_proc* p) {
+    uint32_t epoch = lookup_epoch.load(std::memory_order_seq_cst) & 1;
+    lookups[epoch].fetch_add(1, std::memory_order_seq_cst);
+    const Cache* c = active_cache.load(std::memory_order_seq_cst);
+    bool hit = c && lookup(c, pid, start_time, p);
+    lookups[epoch].fetch_sub(1, std::memory_order_release);
+
+    if (c) {
+        (hit ? hits : misses).fetch_add(1, std::memory_order_relaxed);
+    }
+    return hit;
+}
+
+void memtrack_cache_insert(pid_t pid, uint64_t start_time, const memtrack_proc* p) {
+    for (const auto& type : p->types) {
+        if (type.records.size() > kMaxRecords) {
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(*insert_lock);
+    Cache* c = cache;
+    if (!c) {
+        return;
+    }
+
+    // Prefer the slot already holding this pid, then a free or expired one,
+    // then the CLOCK victim.
+    uint64_t now = memtrack_now_ns();
+    size_t home = home_slot(c, pid);
+    CacheSlot* target = nullptr;
+    for (size_t i = 0; i < kProbeSlots && !target; i++) {
+        CacheSlot* slot = &c->slots[(home + i) & c->mask];
+        if (slot->pid == pid && slot->time_ns) {
+            target = slot;
+        }
+    }
+    for (size_t i = 0; i < kProbeSlots && !target; i++) {
+        CacheSlot* slot = &c->slots[(home + i) & c->mask];
+        if (!slot->time_ns || now - slot->time_ns >= c->ttl_ns) {
+            target = slot;
+        }
+    }
+    for (size_t i = 0; !target; i = (i + 1) % kProbeSlots) {
+        CacheSlot* slot = &c->slots[(home + i) & c->mask];
+        if (!slot->referenced.exchange(false, std::memory_order_relaxed)) {
+            target = slot;
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t seq = target->seq.load(std::memory_order_relaxed);
+    target->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    target->pid = pid;
+    target->start_time = start_time;
+    target->time_ns = now;
+    for (size_t t = 0; t < kNumTypes; t++) {
+        const auto& records = p->types[t].records;
+        target->counts[t] = records.size();
+        std::copy(records.begin(), records.end(), target->records[t]);
+    }
+    target->referenced.store(false, std::memory_order_relaxed);
+
+    target->seq.store(seq + 2, std::memory_order_release);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+/*
+ * The first query for a (pid, type) becomes the leader and calls the
+ * backend; queries for the same (pid, type) that arrive before it returns
+ * wait for its result instead of making their own call.  Queries that
+ * arrive later start a new call, so no result is older than the query.
+ *
+ * Only successful results are shared.  When the leader's call fails, which
+ * includes a low priority leader being shed by the limiter, each follower
+ * makes its own call, so it is not failed for the leader's priority or
+ * transient error.  While the limiter is enabled, flights are also keyed by
+ * priority, so a high priority query never waits for a normal priority
+ * leader that is queued behind it.
+ *
+ * Flights nobody else joined are kept for reuse, so an uncontended query
+ * costs two lock round trips and no allocation.
+ */
+static constexpr size_t kMaxIdleFlights = 16;
+static_assert(static_cast<uint32_t>(MemtrackType::NUM_TYPES) <= 1 << 4,
+              "type and priority must fit in the low byte of a flight key");
+
+struct Flight {
+    bool done = false;
+    unsigned int followers = 0;
+    int status = 0;
+    std::vector<MemtrackRecord> records;
+};
+
+struct Flights {
+    std::mutex lock;
+    std::condition_variable cv;
+    MemtrackFlatMap<std::shared_ptr<Flight>> in_flight;
+    std::vector<std::shared_ptr<Flight>> idle;
+};
+
+/* Intentionally leaked: detached library threads may still query at exit. */
+static Flights* const flights = new Flights();
+static std::atomic<bool> coalescing{true};
+
+int memtrack_set_coalescing(int enable) {
+    coalescing.store(enable != 0, std::memory_order_relaxed);
+    return 0;
+}
+
+bool memtrack_coalescing_enabled() {
+    return coalescing.load(std::memory_order_relaxed);
+}
+
+int memtrack_coalesce(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records,
+                      int (*call)(pid_t, MemtrackType, std::vector<MemtrackRecord>*)) {
+    uint64_t key = static_cast<uint64_t>(pid) << 8 | static_cast<uint32_t>(type);
+    if (memtrack_limit_enabled()) {
+        key |= static_cast<uint32_t>(memtrack_thread_priority()) << 4;
+    }
+
+    std::unique_lock<std::mutex> lock(flights->lock);
+    auto [slot, leader] = flights->in_flight.insert(key);
+    if (!leader) {
+        std::shared_ptr<Flight> f = *slot;
+        f->followers++;
+        flights->cv.wait(lock, [&f] { return f->done; });
+        if (f->status == 0) {
+            records->assign(f->records.begin(), f->records.end());
+            return 0;
+        }
+        lock.unlock();
+        return call(pid, type, records);
+    }
+
+    std::shared_ptr<Flight> f;
+    if (!flights->idle.empty()) {
+        f = std::move(flights->idle.back());
+        flights->idle.pop_back();
+        f->done = false;
+    } else {
+        f = std::make_shared<Flight>();
+    }
+    *slot = f;
+    lock.unlock();
+
+    int ret = call(pid, type, records);
+
+    lock.lock();
+    f->status = ret;
+    if (ret == 0 && f->followers) {
+        f->records = *records;
+    }
+    f->done = true;
+    flights->in_flight.erase(key);
+    if (f->followers) {
+        // The followers still hold the flight, so it is not reused.
+        flights->cv.notify_all();
+    } else if (flights->idle.size() < kMaxIdleFlights) {
+        flights->idle.push_back(std::move(f));
+    }
+    return ret;
+}
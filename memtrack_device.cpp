@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <memtrack/memtrack.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+
+/*
+ * The memtrack HAL 1.0 has no device level query, so device-wide information
+ * is read from the kernel: GPU devices from the DRM class in sysfs, and the
+ * global counters from the per-buffer dma-buf stats.
+ */
+static constexpr const char* kDrmClassPath = "/sys/class/drm";
+static constexpr const char* kDmabufStatsPath = "/sys/kernel/dmabuf/buffers";
+
+struct memtrack_gpu_device {
+    int id;
+    std::string name;
+};
+
+struct memtrack_device_info {
+    std::vector<memtrack_gpu_device> devices;
+    /* 0, -errno if the dma-buf stats could not be read, or -EOVERFLOW if total saturated. */
+    int status;
+    uint64_t total;
+    uint64_t buffer_count;
+};
+
+static std::atomic<unsigned int> cache_ttl_ms{1000};
+static std::mutex cache_lock;
+static std::chrono::steady_clock::time_point cache_time;
+static bool cache_valid = false;
+static memtrack_device_info cache;
+
+static void read_gpu_devices(std::vector<memtrack_gpu_device>* devices) {
+    devices->clear();
+
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(kDrmClassPath), closedir);
+    if (!dir) {
+        return;
+    }
+
+    struct dirent* de;
+    while ((de = readdir(dir.get())) != nullptr) {
+        // Only "cardN" is a device, "cardN-<connector>" entries are outputs.
+        int id;
+        if (strncmp(de->d_name, "card", 4) != 0 ||
+            !::android::base::ParseInt(de->d_name + 4, &id, 0)) {
+            continue;
+        }
+
+        std::string link = ::android::base::StringPrintf("%s/%s/device/driver", kDrmClassPath,
+                                                         de->d_name);
+        char target[PATH_MAX];
+        ssize_t len = readlink(link.c_str(), target, sizeof(target) - 1);
+        std::string name = "<unknown>";
+        if (len > 0) {
+            target[len] = '\0';
+            const char* base = strrchr(target, '/');
+            name = base ? base + 1 : target;
+        }
+        devices->push_back({id, std::move(name)});
+    }
+
+    // readdir() order is arbitrary; list devices by id so output is stable.
+    std::sort(devices->begin(), devices->end(),
+              [](const memtrack_gpu_device& a, const memtrack_gpu_device& b) {
+                  return a.id < b.id;
+              });
+}
+
+static int read_dmabuf_totals(uint64_t* total, uint64_t* count) {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(kDmabufStatsPath), closedir);
+    if (!dir) {
+        return -errno;
+    }
+
+    uint64_t sum = 0;
+    uint64_t n = 0;
+    bool saturated = false;
+    std::string path;
+    std::string buf;
+    struct dirent* de;
+    while ((de = readdir(dir.get())) != nullptr) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+
+        path = ::android::base::StringPrintf("%s/%s/size", kDmabufStatsPath, de->d_name);
+        uint64_t size;
+        if (!::android::base::ReadFileToString(path, &buf) ||
+            !::android::base::ParseUint(buf.substr(0, buf.find('\n')), &size)) {
+            // The buffer may have been freed since the directory was read.
+            continue;
+        }
+        if (__builtin_add_overflow(sum, size, &sum)) {
+            sum = UINT64_MAX;
+            saturated = true;
+        }
+        n++;
+    }
+
+    *total = sum;
+    *count = n;
+    return saturated ? -EOVERFLOW : 0;
+}
+
+static void refresh_cache() {
+    read_gpu_devices(&cache.devices);
+
+    cache.status = read_dmabuf_totals(&cache.total, &cache.buffer_count);
+}
+
+memtrack_device_info* memtrack_device_info_new(void) {
+    return new memtrack_device_info{{}, -ENODATA, 0, 0};
+}
+
+void memtrack_device_info_destroy(memtrack_device_info* d) {
+    delete d;
+}
+
+void memtrack_device_info_set_ttl_ms(unsigned int ttl_ms) {
+    cache_ttl_ms.store(ttl_ms, std::memory_order_relaxed);
+}
+
+int memtrack_device_info_get(memtrack_device_info* d) {
+    if (!d) {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(cache_lock);
+    auto now = std::chrono::steady_clock::now();
+    auto ttl = std::chrono::milliseconds(cache_ttl_ms.load(std::memory_order_relaxed));
+    if (!cache_valid || now - cache_time >= ttl) {
+        refresh_cache();
+        cache_time = now;
+        cache_valid = true;
+    }
+
+    d->devices = cache.devices;
+    d->status = cache.status;
+    d->total = cache.total;
+    d->buffer_count = cache.buffer_count;
+
+    if (d->devices.empty() && d->status < 0 && d->status != -EOVERFLOW) {
+        return -ENODEV;
+    }
+    return 0;
+}
+
+size_t memtrack_device_info_count(memtrack_device_info* d) {
+    return d ? d->devices.size() : 0;
+}
+
+int memtrack_device_info_id(memtrack_device_info* d, size_t i) {
+    if (!d || i >= d->devices.size()) {
+        return -EINVAL;
+    }
+    return d->devices[i].id;
+}
+
+const char* memtrack_device_info_name(memtrack_device_info* d, size_t i) {
+    if (!d || i >= d->devices.size()) {
+        return nullptr;
+    }
+    return d->devices[i].name.c_str();
+}
+
+ssize_t memtrack_device_info_total(memtrack_device_info* d) {
+    uint64_t total;
+    int ret = memtrack_device_info_total_u64(d, &total);
+    if (ret < 0) {
+        return ret;
+    }
+    return total > SSIZE_MAX ? -EOVERFLOW : static_cast<ssize_t>(total);
+}
+
+int memtrack_device_info_total_u64(memtrack_device_info* d, uint64_t* total) {
+    if (!d || !total) {
+        return -EINVAL;
+    }
+    if (d->status < 0 && d->status != -EOVERFLOW) {
+        return d->status;
+    }
+    *total = d->total;
+    return d->status;
+}
+
+ssize_t memtrack_device_info_buffer_count(memtrack_device_info* d) {
+    if (!d) {
+        return -EINVAL;
+    }
+    if (d->status < 0 && d->status != -EOVERFLOW) {
+        return d->status;
+    }
+    return d->buffer_count > SSIZE_MAX ? -EOVERFLOW : static_cast<ssize_t>(d->buffer_count);
+}
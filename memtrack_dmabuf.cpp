@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+
+using ::android::base::StringPrintf;
+
+/*
+ * A process holds a dma-buf if it has an fd to it, listed in
+ * /proc/<pid>/fdinfo with an exp_name field, or maps it, listed in
+ * /proc/<pid>/maps with a /dmabuf path.  Buffers are identified by inode so
+ * a buffer that is both held and mapped, or held through several fds, is
+ * counted once.
+ *
+ * Proportional charging needs the number of processes sharing each buffer,
+ * which takes a scan of every process, so that index is rebuilt at most once
+ * per kSharersTtlNs and reused by the per-process queries in between.  It
+ * is rebuilt by one caller at a time, outside the lock the queries take,
+ * and swapped in when done; queries meanwhile keep using the old one.
+ */
+static constexpr uint64_t kSharersTtlNs = 1000000000ULL;
+
+namespace {
+
+class DmabufBackend : public MemtrackBackend {
+  public:
+    explicit DmabufBackend(const std::string& proc_root)
+        : proc_root_(proc_root), scanner_(proc_root), refresh_scanner_(proc_root) {}
+
+    int getMemory(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records) override;
+
+  private:
+    void refreshSharers(bool wait);
+
+    const std::string proc_root_;
+
+    /* Guards the per-process scan and the current index. */
+    std::mutex lock_;
+    MemtrackDmabufScanner scanner_;
+    MemtrackFlatMap<uint32_t> sharers_;
+    uint64_t sharers_time_ns_ = 0;
+    MemtrackFlatMap<uint64_t> bufs_;
+
+    /* Guards building the next index. */
+    std::mutex refresh_lock_;
+    MemtrackDmabufScanner refresh_scanner_;
+    MemtrackFlatMap<uint32_t> next_sharers_;
+    MemtrackFlatMap<uint64_t> scratch_;
+    std::vector<pid_t> pids_;
+};
+
+}  // namespace
+
+int MemtrackDmabufScanner::scanFdinfo(pid_t pid, MemtrackFlatMap<uint64_t>* bufs) {
+    std::string dir_path = StringPrintf("%s/%d/fdinfo", proc_root_.c_str(), pid);
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(dir_path.c_str()), closedir);
+    if (!dir) {
+        return -errno;
+    }
+
+    struct dirent* de;
+    while ((de = readdir(dir.get())) != nullptr) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+
+        ::android::base::unique_fd fd(openat(dirfd(dir.get()), de->d_name, O_RDONLY | O_CLOEXEC));
+        if (fd < 0) {
+            continue;
+        }
+        ssize_t len = TEMP_FAILURE_RETRY(read(fd, fdinfo_, sizeof(fdinfo_) - 1));
+        if (len <= 0) {
+            continue;
+        }
+        fdinfo_[len] = '\0';
+
+        if (!memtrack_find_field(fdinfo_, "exp_name:")) {
+            continue;
+        }
+        const char* size_field = memtrack_find_field(fdinfo_, "size:");
+        if (!size_field) {
+            continue;
+        }
+        uint64_t size = strtoull(size_field, nullptr, 10);
+
+        // Older kernels don't print the inode in fdinfo, fall back to the fd.
+        uint64_t inode;
+        const char* ino_field = memtrack_find_field(fdinfo_, "ino:");
+        if (ino_field) {
+            inode = strtoull(ino_field, nullptr, 10);
+        } else {
+            struct stat st;
+            std::string fd_path =
+                    StringPrintf("%s/%d/fd/%s", proc_root_.c_str(), pid, de->d_name);
+            if (stat(fd_path.c_str(), &st) < 0) {
+                continue;
+            }
+            inode = st.st_ino;
+        }
+
+        *bufs->insert(inode).first = size;
+    }
+    return 0;
+}
+
+int MemtrackDmabufScanner::scanMaps(pid_t pid, MemtrackFlatMap<uint64_t>* bufs) {
+    std::string path = StringPrintf("%s/%d/maps", proc_root_.c_str(), pid);
+    if (!::android::base::ReadFileToString(path, &maps_)) {
+        return -errno;
+    }
+
+    for (const char* line = maps_.c_str(); *line;) {
+        const char* end = strchrnul(line, '\n');
+        uint64_t start, stop, inode;
+        int path_off = 0;
+        if (sscanf(line, "%" SCNx64 "-%" SCNx64 " %*s %*s %*s %" SCNu64 " %n", &start, &stop,
+                   &inode, &path_off) == 3 &&
+            path_off > 0 && path_off < end - line) {
+            const char* name = line + path_off;
+            if (!strncmp(name, "/dmabuf", strlen("/dmabuf")) ||
+                !strncmp(name, "anon_inode:dmabuf", strlen("anon_inode:dmabuf"))) {
+                // The size from fdinfo is exact; a mapping may cover only
+                // part of the buffer, so use the largest one seen otherwise.
+                auto [size, inserted] = bufs->insert(inode);
+                if (inserted || *size < stop - start) {
+                    *size = stop - start;
+                }
+            }
+        }
+        line = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+int MemtrackDmabufScanner::scan(pid_t pid, MemtrackFlatMap<uint64_t>* bufs) {
+    // Buffers from fdinfo go first so their exact size is never replaced by
+    // a partial mapping.
+    int ret = scanFdinfo(pid, bufs);
+    if (ret < 0) {
+        return ret;
+    }
+    return scanMaps(pid, bufs);
+}
+
+/*
+ * Rebuild the sharers index.  Unless wait is set, return at once if another
+ * caller is already rebuilding it.
+ */
+void DmabufBackend::refreshSharers(bool wait) {
+    std::unique_lock<std::mutex> refresh(refresh_lock_, std::defer_lock);
+    if (wait) {
+        refresh.lock();
+    } else if (!refresh.try_lock()) {
+        return;
+    }
+
+    uint64_t now = memtrack_now_ns();
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (sharers_time_ns_ != 0 && now - sharers_time_ns_ < kSharersTtlNs) {
+            // Rebuilt by another caller while this one waited.
+            return;
+        }
+    }
+
+    next_sharers_.clear();
+    pids_.clear();
+    // Kernel threads hold no dma-bufs.
+    if (memtrack_list_pids(&pids_, proc_root_.c_str(), true) < 0) {
+        return;
+    }
+    for (pid_t pid : pids_) {
+        scratch_.clear();
+        if (refresh_scanner_.scan(pid, &scratch_) < 0) {
+            continue;
+        }
+        scratch_.for_each(
+                [this](uint64_t inode, uint64_t) { ++*next_sharers_.insert(inode).first; });
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+    std::swap(sharers_, next_sharers_);
+    sharers_time_ns_ = memtrack_now_ns();
+}
+
+int DmabufBackend::getMemory(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records) {
+    records->clear();
+    if (type != MemtrackType::GRAPHICS) {
+        return 0;
+    }
+
+    uint64_t sharers_time_ns;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        sharers_time_ns = sharers_time_ns_;
+    }
+    if (sharers_time_ns == 0 || memtrack_now_ns() - sharers_time_ns >= kSharersTtlNs) {
+        // Only the first queries wait for an index; later ones use the stale
+        // one while it is rebuilt.
+        refreshSharers(sharers_time_ns == 0);
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+    bufs_.clear();
+    int ret = scanner_.scan(pid, &bufs_);
+    if (ret < 0) {
+        return ret;
+    }
+
+    uint64_t private_size = 0;
+    uint64_t pss = 0;
+    uint64_t shared_rest = 0;
+    bufs_.for_each([&](uint64_t inode, uint64_t size) {
+        // A buffer missing from the index was allocated since it was built.
+        uint32_t* n = sharers_.find(inode);
+        if (!n || *n <= 1) {
+            private_size += size;
+        } else {
+            pss += size / *n;
+            shared_rest += size - size / *n;
+        }
+    });
+
+    // The memory other processes are charged for is part of the total but
+    // not of the pss, so it is reported without SMAPS_UNACCOUNTED.
+    if (private_size) {
+        records->push_back({private_size, static_cast<uint32_t>(MemtrackFlag::SMAPS_UNACCOUNTED) |
+                                                  static_cast<uint32_t>(MemtrackFlag::PRIVATE)});
+    }
+    if (pss) {
+        records->push_back({pss, static_cast<uint32_t>(MemtrackFlag::SMAPS_UNACCOUNTED) |
+                                         static_cast<uint32_t>(MemtrackFlag::SHARED_PSS)});
+    }
+    if (shared_rest) {
+        records->push_back({shared_rest, static_cast<uint32_t>(MemtrackFlag::SHARED)});
+    }
+    return 0;
+}
+
+std::unique_ptr<MemtrackBackend> memtrack_create_dmabuf_backend(const std::string& proc_root) {
+    return std::make_unique<DmabufBackend>(proc_root);
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+
+/*
+ * DRM drivers describe each client (open device file) in its fdinfo, see
+ * Documentation/gpu/drm-usage-stats.rst:
+ *
+ *   drm-driver:       <name>
+ *   drm-pdev:         <bus address>
+ *   drm-client-id:    <id>
+ *   drm-total-<region>:   <size> [KiB|MiB|GiB]
+ *   drm-shared-<region>:  <size> [KiB|MiB|GiB]
+ *   drm-memory-<region>:  <size> [KiB|MiB|GiB]   (before drm-total-*)
+ *
+ * Several fds can refer to one client, so clients are counted once per
+ * (pdev, client id).  Memory shared with other clients is reported without
+ * SMAPS_UNACCOUNTED so it only counts towards the total.
+ */
+static constexpr size_t kFdinfoBufSize = 4096;
+
+namespace {
+
+struct DrmClient {
+    bool is_drm;
+    bool has_id;
+    uint64_t key;
+    bool has_total;
+    uint64_t total;
+    uint64_t memory;
+    uint64_t shared;
+};
+
+class DrmBackend : public MemtrackBackend {
+  public:
+    explicit DrmBackend(const std::string& proc_root)
+        : proc_root_(proc_root), buf_(kFdinfoBufSize) {}
+
+    int getMemory(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records) override;
+
+  private:
+    /* Read an fdinfo file into buf_ with a single read in the common case. */
+    bool readFdinfo(int dir_fd, const char* name);
+
+    const std::string proc_root_;
+
+    std::mutex lock_;
+    std::vector<char> buf_;
+    MemtrackFlatMap<bool> clients_;
+};
+
+}  // namespace
+
+static uint64_t hash_str(const char* s, const char* end) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; s < end; s++) {
+        h = (h ^ static_cast<uint8_t>(*s)) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t parse_size(const char* value) {
+    char* unit;
+    uint64_t size = strtoull(value, &unit, 10);
+    while (*unit == ' ' || *unit == '\t') {
+        unit++;
+    }
+    if (!strncmp(unit, "KiB", 3)) {
+        size <<= 10;
+    } else if (!strncmp(unit, "MiB", 3)) {
+        size <<= 20;
+    } else if (!strncmp(unit, "GiB", 3)) {
+        size <<= 30;
+    }
+    return size;
+}
+
+/* Parse the drm-* keys of one fdinfo file in a single pass over its lines. */
+static void parse_drm_fdinfo(const char* buf, DrmClient* c) {
+    *c = {};
+    uint64_t pdev = 0;
+    uint64_t id = 0;
+
+    for (const char* line = buf; *line;) {
+        const char* end = strchrnul(line, '\n');
+        const char* colon = static_cast<const char*>(memchr(line, ':', end - line));
+        if (colon && !strncmp(line, "drm-", 4)) {
+            const char* key = line + 4;
+            const char* value = colon + 1;
+            while (*value == ' ' || *value == '\t') {
+                value++;
+            }
+
+            if (!strncmp(key, "driver:", 7)) {
+                c->is_drm = true;
+            } else if (!strncmp(key, "pdev:", 5)) {
+                pdev = hash_str(value, end);
+            } else if (!strncmp(key, "client-id:", 10)) {
+                id = strtoull(value, nullptr, 10);
+                c->has_id = true;
+            } else if (!strncmp(key, "total-", 6)) {
+                c->total += parse_size(value);
+                c->has_total = true;
+            } else if (!strncmp(key, "memory-", 7)) {
+                c->memory += parse_size(value);
+            } else if (!strncmp(key, "shared-", 7)) {
+                c->shared += parse_size(value);
+            }
+        }
+        line = *end ? end + 1 : end;
+    }
+
+    c->key = pdev ^ (id * 0x9e3779b97f4a7c15ULL);
+}
+
+bool DrmBackend::readFdinfo(int dir_fd, const char* name) {
+    ::android::base::unique_fd fd(openat(dir_fd, name, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+
+    // fdinfo is generated in full on every read from offset 0, so a file
+    // that didn't fit is simply read again into a larger buffer.
+    for (;;) {
+        ssize_t len = TEMP_FAILURE_RETRY(pread(fd, buf_.data(), buf_.size() - 1, 0));
+        if (len < 0) {
+            return false;
+        }
+        if (static_cast<size_t>(len) < buf_.size() - 1) {
+            buf_[len] = '\0';
+            return true;
+        }
+        buf_.resize(buf_.size() * 2);
+    }
+}
+
+int DrmBackend::getMemory(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records) {
+    records->clear();
+    if (type != MemtrackType::GL) {
+        return 0;
+    }
+
+    std::string path = ::android::base::StringPrintf("%s/%d/fdinfo", proc_root_.c_str(), pid);
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(path.c_str()), closedir);
+    if (!dir) {
+        return -errno;
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+    clients_.clear();
+
+    uint64_t private_size = 0;
+    uint64_t shared = 0;
+    struct dirent* de;
+    while ((de = readdir(dir.get())) != nullptr) {
+        if (de->d_name[0] == '.' || !readFdinfo(dirfd(dir.get()), de->d_name)) {
+            continue;
+        }
+
+        DrmClient c;
+        parse_drm_fdinfo(buf_.data(), &c);
+        if (!c.is_drm || (c.has_id && !clients_.insert(c.key).second)) {
+            continue;
+        }
+
+        uint64_t total = c.has_total ? c.total : c.memory;
+        uint64_t client_shared = std::min(c.shared, total);
+        private_size += total - client_shared;
+        shared += client_shared;
+    }
+
+    if (private_size) {
+        records->push_back({private_size, static_cast<uint32_t>(MemtrackFlag::SMAPS_UNACCOUNTED) |
+                                                  static_cast<uint32_t>(MemtrackFlag::PRIVATE)});
+    }
+    if (shared) {
+        records->push_back({shared, static_cast<uint32_t>(MemtrackFlag::SHARED)});
+    }
+    return 0;
+}
+
+std::unique_ptr<MemtrackBackend> memtrack_create_drm_backend(const std::string& proc_root) {
+    return std::make_unique<DrmBackend>(proc_root);
+}
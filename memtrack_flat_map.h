@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBMEMTRACK_MEMTRACK_FLAT_MAP_H_
+#define _LIBMEMTRACK_MEMTRACK_FLAT_MAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+/*
+ * Open addressing hash map from uint64_t keys to small values, with linear
+ * probing and backward shift deletion.  All slots live in one array, so
+ * clear() keeps the capacity and a map that is refilled with a similar number
+ * of keys on every sweep stops allocating after the first one.
+ */
+template <typename V>
+class MemtrackFlatMap {
+  public:
+    V* find(uint64_t key) {
+        if (size_ == 0) {
+            return nullptr;
+        }
+        for (size_t i = slot(key);; i = (i + 1) & mask()) {
+            if (!slots_[i].used) {
+                return nullptr;
+            }
+            if (slots_[i].key == key) {
+                return &slots_[i].value;
+            }
+        }
+    }
+
+    /* Return the value for key, inserting a default constructed one if absent. */
+    std::pair<V*, bool> insert(uint64_t key) {
+        if ((size_ + 1) * 4 > slots_.size() * 3) {
+            grow();
+        }
+        size_t i = slot(key);
+        for (; slots_[i].used; i = (i + 1) & mask()) {
+            if (slots_[i].key == key) {
+                return {&slots_[i].value, false};
+            }
+        }
+        slots_[i].used = true;
+        slots_[i].key = key;
+        slots_[i].value = V();
+        size_++;
+        return {&slots_[i].value, true};
+    }
+
+    bool erase(uint64_t key) {
+        if (size_ == 0) {
+            return false;
+        }
+        size_t i = slot(key);
+        for (;; i = (i + 1) & mask()) {
+            if (!slots_[i].used) {
+                return false;
+            }
+            if (slots_[i].key == key) {
+                break;
+            }
+        }
+
+        // Shift back any following entry whose home slot is at or before the
+        // hole, so that lookups never stop early at an empty slot.
+        for (size_t j = (i + 1) & mask(); slots_[j].used; j = (j + 1) & mask()) {
+            size_t home = slot(slots_[j].key);
+            if (((j - home) & mask()) >= ((j - i) & mask())) {
+                slots_[i] = std::move(slots_[j]);
+                i = j;
+            }
+        }
+        slots_[i].used = false;
+        size_--;
+        return true;
+    }
+
+    /* Call fn(key, value&) for every entry, in no particular order. */
+    template <typename F>
+    void for_each(F fn) {
+        for (auto& s : slots_) {
+            if (s.used) {
+                fn(s.key, s.value);
+            }
+        }
+    }
+
+    void clear() {
+        for (auto& s : slots_) {
+            s.used = false;
+        }
+        size_ = 0;
+    }
+
+    size_t size() const { return size_; }
+
+  private:
+    struct Slot {
+        uint64_t key;
+        bool used;
+        V value;
+    };
+
+    size_t mask() const { return slots_.size() - 1; }
+
+    size_t slot(uint64_t key) const {
+        // Fibonacci hashing spreads sequential keys such as pids and inodes.
+        return (key * 0x9e3779b97f4a7c15ULL) >> shift_;
+    }
+
+    void grow() {
+        std::vector<Slot> old = std::move(slots_);
+        size_t capacity = old.empty() ? 16 : old.size() * 2;
+        slots_.assign(capacity, Slot{0, false, V()});
+        shift_ = 64 - __builtin_ctzll(capacity);
+        size_ = 0;
+        for (auto& s : old) {
+            if (s.used) {
+                *insert(s.key).first = std::move(s.value);
+            }
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+    int shift_ = 64;
+};
+
+#endif
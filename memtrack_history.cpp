@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/unique_fd.h>
+
+/*
+ * The ring file is a header followed by data_size bytes of records.  head and
+ * tail are logical byte offsets that only grow; a byte at logical offset o is
+ * stored at data[o % data_size], and the records live in [tail, head).
+ *
+ * Each record is a varint payload length followed by the payload:
+ *   varint time_ns
+ *   varint count
+ *   count times:
+ *     zigzag varint pid delta from the previous entry
+ *     zigzag varint start_time delta from the previous entry
+ *     3 times, for graphics, gl and other:
+ *       varint total
+ *       zigzag varint pss minus total
+ *
+ * Records are self-contained so that dropping the oldest one never breaks
+ * the decoding of the next.  pss is coded against the total of the same
+ * type, which it is usually equal or close to, and zero sizes take a byte.
+ */
+static constexpr uint32_t kHistoryMagic = 0x484b544d;  // "MTKH"
+static constexpr uint32_t kHistoryVersion = 3;
+
+struct memtrack_history_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t data_size;
+    uint64_t head;
+    uint64_t tail;
+};
+
+struct memtrack_history {
+    memtrack_history_header* hdr;
+    uint8_t* data;
+    size_t map_size;
+};
+
+struct memtrack_history_reader {
+    const uint8_t* data;
+    uint64_t data_size;
+    uint64_t pos;
+    uint64_t head;
+    void* map;
+    size_t map_size;
+};
+
+static uint64_t zigzag(uint64_t cur, uint64_t prev) {
+    int64_t d = static_cast<int64_t>(cur - prev);
+    return (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63);
+}
+
+static uint64_t unzigzag(uint64_t v, uint64_t prev) {
+    return prev + ((v >> 1) ^ -(v & 1));
+}
+
+static size_t varint_len(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static void put_varint(uint8_t* data, uint64_t size, uint64_t* pos, uint64_t v) {
+    while (v >= 0x80) {
+        data[(*pos)++ % size] = static_cast<uint8_t>(v) | 0x80;
+        v >>= 7;
+    }
+    data[(*pos)++ % size] = static_cast<uint8_t>(v);
+}
+
+static bool get_varint(const uint8_t* data, uint64_t size, uint64_t* pos, uint64_t end,
+                       uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *pos < end; shift += 7) {
+        uint8_t b = data[(*pos)++ % size];
+        result |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The varints that encode the sizes of an entry. */
+static void encode_sizes(const memtrack_snapshot_entry& e, uint64_t v[6]) {
+    v[0] = e.graphics_total;
+    v[1] = zigzag(e.graphics_pss, e.graphics_total);
+    v[2] = e.gl_total;
+    v[3] = zigzag(e.gl_pss, e.gl_total);
+    v[4] = e.other_total;
+    v[5] = zigzag(e.other_pss, e.other_total);
+}
+
+static void decode_sizes(const uint64_t v[6], memtrack_snapshot_entry* e) {
+    e->graphics_total = v[0];
+    e->graphics_pss = unzigzag(v[1], v[0]);
+    e->gl_total = v[2];
+    e->gl_pss = unzigzag(v[3], v[2]);
+    e->other_total = v[4];
+    e->other_pss = unzigzag(v[5], v[4]);
+}
+
+static size_t payload_len(const memtrack_snapshot* s) {
+    size_t len = varint_len(s->time_ns) + varint_len(s->entries.size());
+    pid_t prev_pid = 0;
+    uint64_t prev_start_time = 0;
+    for (const auto& e : s->entries) {
+        len += varint_len(zigzag(e.pid, prev_pid));
+        prev_pid = e.pid;
+        len += varint_len(zigzag(e.start_time, prev_start_time));
+        prev_start_time = e.start_time;
+
+        uint64_t sizes[6];
+        encode_sizes(e, sizes);
+        for (uint64_t v : sizes) {
+            len += varint_len(v);
+        }
+    }
+    return len;
+}
+
+memtrack_history* memtrack_history_open(const char* path, size_t size) {
+    if (!path || size == 0) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    ::android::base::unique_fd fd(open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    size_t map_size = sizeof(memtrack_history_header) + size;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return nullptr;
+    }
+    bool reuse = static_cast<size_t>(st.st_size) == map_size;
+    if (!reuse && ftruncate(fd, map_size) < 0) {
+        return nullptr;
+    }
+
+    void* addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto hdr = static_cast<memtrack_history_header*>(addr);
+    if (!reuse || hdr->magic != kHistoryMagic || hdr->version != kHistoryVersion ||
+        hdr->data_size != size || hdr->tail > hdr->head || hdr->head - hdr->tail > size) {
+        hdr->magic = kHistoryMagic;
+        hdr->version = kHistoryVersion;
+        hdr->data_size = size;
+        hdr->head = 0;
+        hdr->tail = 0;
+    }
+
+    return new memtrack_history{hdr, static_cast<uint8_t*>(addr) + sizeof(*hdr), map_size};
+}
+
+void memtrack_history_close(memtrack_history* h) {
+    if (h) {
+        munmap(h->hdr, h->map_size);
+        delete h;
+    }
+}
+
+int memtrack_history_append(memtrack_history* h, memtrack_snapshot* s) {
+    if (!h || !s) {
+        return -EINVAL;
+    }
+
+    memtrack_history_header* hdr = h->hdr;
+    uint64_t size = hdr->data_size;
+    size_t len = payload_len(s);
+    uint64_t total = varint_len(len) + len;
+    if (total > size) {
+        return -E2BIG;
+    }
+
+    // Drop the oldest records until the new one fits.  tail is updated
+    // before any byte is overwritten so the ring stays readable throughout.
+    uint64_t tail = hdr->tail;
+    while (hdr->head + total - tail > size) {
+        uint64_t rec_len;
+        if (!get_varint(h->data, size, &tail, hdr->head, &rec_len)) {
+            tail = hdr->head;
+            break;
+        }
+        tail += rec_len;
+    }
+    hdr->tail = tail;
+
+    uint64_t pos = hdr->head;
+    put_varint(h->data, size, &pos, len);
+    put_varint(h->data, size, &pos, s->time_ns);
+    put_varint(h->data, size, &pos, s->entries.size());
+    pid_t prev_pid = 0;
+    uint64_t prev_start_time = 0;
+    for (const auto& e : s->entries) {
+        put_varint(h->data, size, &pos, zigzag(e.pid, prev_pid));
+        prev_pid = e.pid;
+        put_varint(h->data, size, &pos, zigzag(e.start_time, prev_start_time));
+        prev_start_time = e.start_time;
+
+        uint64_t sizes[6];
+        encode_sizes(e, sizes);
+        for (uint64_t v : sizes) {
+            put_varint(h->data, size, &pos, v);
+        }
+    }
+    hdr->head = pos;
+
+    return 0;
+}
+
+memtrack_history_reader* memtrack_history_reader_open(const char* path) {
+    if (!path) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    ::android::base::unique_fd fd(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return nullptr;
+    }
+    size_t map_size = st.st_size;
+    if (map_size < sizeof(memtrack_history_header)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    void* addr = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto hdr = static_cast<const memtrack_history_header*>(addr);
+    if (hdr->magic != kHistoryMagic || hdr->version != kHistoryVersion || hdr->data_size == 0 ||
+        sizeof(*hdr) + hdr->data_size != map_size || hdr->tail > hdr->head ||
+        hdr->head - hdr->tail > hdr->data_size) {
+        munmap(addr, map_size);
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    return new memtrack_history_reader{static_cast<const uint8_t*>(addr) + sizeof(*hdr),
+                                       hdr->data_size,
+                                       hdr->tail,
+                                       hdr->head,
+                                       addr,
+                                       map_size};
+}
+
+void memtrack_history_reader_close(memtrack_history_reader* r) {
+    if (r) {
+        munmap(r->map, r->map_size);
+        delete r;
+    }
+}
+
+int memtrack_history_next(memtrack_history_reader* r, memtrack_snapshot* s) {
+    if (!r || !s) {
+        return -EINVAL;
+    }
+    if (r->pos >= r->head) {
+        return 0;
+    }
+
+    uint64_t pos = r->pos;
+    uint64_t len;
+    if (!get_varint(r->data, r->data_size, &pos, r->head, &len) || len > r->head - pos) {
+        return -EINVAL;
+    }
+    uint64_t end = pos + len;
+
+    uint64_t count;
+    if (!get_varint(r->data, r->data_size, &pos, end, &s->time_ns) ||
+        !get_varint(r->data, r->data_size, &pos, end, &count) || count > len) {
+        return -EINVAL;
+    }
+
+    s->entries.resize(count);
+    s->uids.clear();
+    s->cgroups.clear();
+    s->dmabufs.clear();
+    s->dmabuf_total = 0;
+    pid_t prev_pid = 0;
+    uint64_t prev_start_time = 0;
+    for (auto& e : s->entries) {
+        uint64_t v;
+        if (!get_varint(r->data, r->data_size, &pos, end, &v)) {
+            return -EINVAL;
+        }
+        e.pid = static_cast<pid_t>(unzigzag(v, prev_pid));
+        prev_pid = e.pid;
+        if (!get_varint(r->data, r->data_size, &pos, end, &v)) {
+            return -EINVAL;
+        }
+        e.start_time = unzigzag(v, prev_start_time);
+        prev_start_time = e.start_time;
+
+        uint64_t sizes[6];
+        for (uint64_t& size : sizes) {
+            if (!get_varint(r->data, r->data_size, &pos, end, &size)) {
+                return -EINVAL;
+            }
+        }
+        decode_sizes(sizes, &e);
+    }
+
+    r->pos = end;
+    return 1;
+}
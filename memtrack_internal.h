@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBMEMTRACK_MEMTRACK_INTERNAL_H_
+#define _LIBMEMTRACK_MEMTRACK_INTERNAL_H_
+
+#include <android/hardware/memtrack/1.0/IMemtrack.h>
+#include <memtrack/memtrack.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "memtrack_flat_map.h"
+
+/* Definitions shared between the translation units of libmemtrack. */
+
+using android::hardware::memtrack::V1_0::MemtrackFlag;
+using android::hardware::memtrack::V1_0::MemtrackRecord;
+using android::hardware::memtrack::V1_0::MemtrackType;
+
+struct memtrack_proc_type {
+    MemtrackType type;
+    /* 0 if records are valid for pid, -errno otherwise */
+    int status;
+    std::vector<MemtrackRecord> records;
+};
+
+struct memtrack_proc {
+    pid_t pid;
+    uint64_t start_time;
+    memtrack_proc_type types[static_cast<int>(MemtrackType::NUM_TYPES)];
+};
+
+/*
+ * A source of per-process memory records.  Records have the same meaning as
+ * the ones returned by the memtrack HAL, whatever the backend reads them from.
+ * Backends may be called from several threads at once.
+ */
+class MemtrackBackend {
+  public:
+    virtual ~MemtrackBackend() = default;
+
+    /* Replace records with the records of pid for type.  Returns 0 or -errno. */
+    virtual int getMemory(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records) = 0;
+};
+
+/*
+ * Backend attributing dma-bufs to the processes that hold an fd to them or
+ * map them, reading procfs under proc_root.  Buffers shared by several
+ * processes are charged to each in proportion in the pss records.
+ */
+std::unique_ptr<MemtrackBackend> memtrack_create_dmabuf_backend(const std::string& proc_root);
+
+/*
+ * Finds the dma-bufs held or mapped by a process, under proc_root.  Not
+ * thread-safe; the buffers used for reading procfs are reused across scans.
+ */
+class MemtrackDmabufScanner {
+  public:
+    explicit MemtrackDmabufScanner(const std::string& proc_root) : proc_root_(proc_root) {}
+
+    /* Add the buffers of pid to bufs, as inode -> size.  Returns 0 or -errno. */
+    int scan(pid_t pid, MemtrackFlatMap<uint64_t>* bufs);
+
+  private:
+    int scanFdinfo(pid_t pid, MemtrackFlatMap<uint64_t>* bufs);
+    int scanMaps(pid_t pid, MemtrackFlatMap<uint64_t>* bufs);
+
+    const std::string proc_root_;
+    std::string maps_;
+    char fdinfo_[1024];
+};
+
+/*
+ * Backend reporting GL memory from the drm-* keys that DRM drivers print in
+ * /proc/<pid>/fdinfo, reading procfs under proc_root.
+ */
+std::unique_ptr<MemtrackBackend> memtrack_create_drm_backend(const std::string& proc_root);
+
+struct memtrack_dmabuf_index_entry {
+    uint64_t size;
+    uint32_t sharers;
+};
+
+struct memtrack_dmabuf_ref {
+    uint32_t process;
+    uint64_t inode;
+};
+
+struct memtrack_zero_pid {
+    uint64_t start_time;
+    uint32_t streak;
+    uint64_t probed;
+    uint64_t seen;
+};
+
+struct memtrack_snapshot {
+    uint64_t time_ns;
+    std::vector<memtrack_snapshot_entry> entries;
+    uint32_t grouping;
+    std::vector<memtrack_snapshot_group> uids;
+    std::vector<memtrack_snapshot_group> cgroups;
+    std::vector<std::string> cgroup_paths;
+    bool dmabuf_index;
+    uint64_t dmabuf_total;
+    std::vector<memtrack_snapshot_dmabuf> dmabufs;
+    /* scratch state reused across memtrack_snapshot_take calls */
+    std::vector<pid_t> pids;
+    memtrack_proc* proc;
+    MemtrackFlatMap<size_t> uid_index;
+    MemtrackFlatMap<size_t> cgroup_index;
+    std::vector<char> buf;
+    std::unique_ptr<MemtrackDmabufScanner> dmabuf_scanner;
+    MemtrackFlatMap<memtrack_dmabuf_index_entry> dmabuf_bufs;
+    MemtrackFlatMap<uint64_t> dmabuf_pid_bufs;
+    std::vector<memtrack_dmabuf_ref> dmabuf_refs;
+    unsigned int zero_probe_every;
+    unsigned int zero_full_every;
+    uint64_t sweep;
+    size_t skipped;
+    MemtrackFlatMap<memtrack_zero_pid> zero_pids;
+    std::vector<uint64_t> stale_pids;
+};
+
+/* Whether the per-process result cache is configured. */
+bool memtrack_cache_enabled();
+
+/*
+ * Fill p with the cached records of the process (pid, start_time) if they are
+ * younger than the cache ttl.  Never blocks on writers.  Returns true on hit.
+ */
+bool memtrack_cache_lookup(pid_t pid, uint64_t start_time, memtrack_proc* p);
+
+/* Cache the records in p for the process (pid, start_time). */
+void memtrack_cache_insert(pid_t pid, uint64_t start_time, const memtrack_proc* p);
+
+/* True if memtrack_limit_configure() enabled the backend call limiter. */
+bool memtrack_limit_enabled();
+
+/*
+ * Take a token of the backend call limiter for a call at the priority of the
+ * calling thread, waiting for one if needed.  Returns 0, or -EAGAIN if a low
+ * priority call was shed.
+ */
+int memtrack_limit_acquire();
+
+/* Priority set by memtrack_set_thread_priority() for the calling thread. */
+memtrack_priority memtrack_thread_priority();
+
+/* True unless memtrack_set_coalescing() turned coalescing off. */
+bool memtrack_coalescing_enabled();
+
+/*
+ * Run call(pid, type, records), unless a call for the same pid and type is
+ * already in flight, in which case wait for it and return its result if it
+ * succeeded, or make the call itself if it failed.
+ */
+int memtrack_coalesce(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records,
+                      int (*call)(pid_t, MemtrackType, std::vector<MemtrackRecord>*));
+
+/*
+ * Run the watch scheduler on the simulated clock *clock, in nanoseconds,
+ * instead of its thread, or on CLOCK_MONOTONIC again if clock is NULL.  For
+ * tests, before any watch is added.  Returns 0, or -EBUSY if the scheduler
+ * thread has already started.
+ */
+int memtrack_watch_set_clock(uint64_t* clock);
+
+/*
+ * Advance the simulated clock to time_ns, jumping from one wakeup of the
+ * scheduler to the next and sampling the watches due at each.
+ */
+void memtrack_watch_run_until(uint64_t time_ns);
+
+/* True while memtrack_record_start() is capturing backend responses. */
+bool memtrack_recording();
+
+/* Append one backend response to the trace being recorded. */
+void memtrack_record(pid_t pid, MemtrackType type, int status,
+                     const std::vector<MemtrackRecord>& records, uint64_t latency_ns);
+
+/* The backend serving the trace loaded by memtrack_replay_load(), or NULL. */
+MemtrackBackend* memtrack_replay_backend();
+
+/* True if MEMTRACK_BACKEND_REPLAY is selected. */
+bool memtrack_replaying();
+
+/* Append the pids of the loaded trace to pids, in ascending order. */
+void memtrack_replay_list_pids(std::vector<pid_t>* pids);
+
+/* CLOCK_MONOTONIC in nanoseconds. */
+uint64_t memtrack_now_ns();
+
+/*
+ * Append the pid of every process in proc_root to pids, in ascending order,
+ * leaving out kernel threads if skip_kthreads is set.
+ */
+int memtrack_list_pids(std::vector<pid_t>* pids, const char* proc_root = "/proc",
+                       bool skip_kthreads = false);
+
+/*
+ * Read <proc_root>/<pid>/<name> into buf with a single read, NUL terminating
+ * it.  Returns the number of bytes read, or -errno.
+ */
+ssize_t memtrack_read_proc_file(pid_t pid, const char* name, char* buf, size_t size,
+                                const char* proc_root = "/proc");
+
+/*
+ * Read the start time of a process (field 22 of <proc_root>/<pid>/stat, in
+ * clock ticks since boot).  Returns 0 on success, -errno on error.
+ */
+int memtrack_read_start_time(pid_t pid, uint64_t* start_time, const char* proc_root = "/proc");
+
+/*
+ * Return a pointer just past "key" at the start of a line of buf, as in the
+ * "key:\tvalue" files of procfs, or NULL if there is no such line.
+ */
+const char* memtrack_find_field(const char* buf, const char* key);
+
+#endif
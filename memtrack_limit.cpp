@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/*
+ * Token bucket in front of backend calls.  The bucket holds up to burst
+ * tokens and refills at rate tokens per second; every backend call takes
+ * one.  A caller waits while an earlier waiter of higher priority is
+ * waiting, so high priority callers are served first under load: it sleeps
+ * until that waiter has taken its token, rather than polling for it.  Low
+ * priority callers never wait: they are shed with -EAGAIN when the bucket
+ * is below the half kept in reserve for the others, which is at least one
+ * token.
+ */
+static constexpr int kNumPriorities = MEMTRACK_PRIORITY_LOW + 1;
+
+static std::atomic<bool> limit_enabled{false};
+/* Intentionally leaked: detached library threads may still query at exit. */
+static std::mutex* const limit_lock = new std::mutex();
+static std::condition_variable* const limit_cv = new std::condition_variable();
+static double limit_rate;
+static double limit_burst;
+static double limit_tokens;
+static uint64_t limit_time_ns;
+static unsigned int limit_waiting[kNumPriorities];
+
+static thread_local memtrack_priority thread_priority = MEMTRACK_PRIORITY_NORMAL;
+
+int memtrack_limit_configure(unsigned int calls_per_sec, unsigned int burst) {
+    if (calls_per_sec && !burst) {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(*limit_lock);
+    limit_rate = calls_per_sec;
+    limit_burst = burst;
+    limit_tokens = burst;
+    limit_time_ns = memtrack_now_ns();
+    limit_enabled.store(calls_per_sec != 0, std::memory_order_relaxed);
+    // Let waiters see the new rate, or go ahead if the limit was lifted.
+    limit_cv->notify_all();
+    return 0;
+}
+
+int memtrack_set_thread_priority(memtrack_priority priority) {
+    if (priority < MEMTRACK_PRIORITY_HIGH || priority > MEMTRACK_PRIORITY_LOW) {
+        return -EINVAL;
+    }
+    thread_priority = priority;
+    return 0;
+}
+
+memtrack_priority memtrack_thread_priority() {
+    return thread_priority;
+}
+
+bool memtrack_limit_enabled() {
+    return limit_enabled.load(std::memory_order_relaxed);
+}
+
+int memtrack_limit_acquire() {
+    int prio = thread_priority;
+    std::unique_lock<std::mutex> lock(*limit_lock);
+    for (;;) {
+        if (!limit_enabled.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+
+        uint64_t now = memtrack_now_ns();
+        limit_tokens =
+                std::min(limit_burst, limit_tokens + (now - limit_time_ns) * limit_rate / 1e9);
+        limit_time_ns = now;
+
+        double needed = 1;
+        if (prio == MEMTRACK_PRIORITY_LOW) {
+            needed += std::max(1u, static_cast<unsigned int>(limit_burst) / 2);
+        }
+        auto waiting = [](unsigned int n) { return n != 0; };
+        bool queued = std::any_of(limit_waiting, limit_waiting + prio, waiting);
+        if (!queued && limit_tokens >= needed) {
+            limit_tokens -= 1;
+            // Lower priority waiters sleep until this one is served.
+            if (std::any_of(limit_waiting + prio + 1, limit_waiting + kNumPriorities, waiting)) {
+                limit_cv->notify_all();
+            }
+            return 0;
+        }
+        if (prio == MEMTRACK_PRIORITY_LOW) {
+            return -EAGAIN;
+        }
+
+        limit_waiting[prio]++;
+        if (queued) {
+            // Woken once a higher priority waiter has taken its token.
+            limit_cv->wait(lock);
+        } else {
+            // Sleep until the next token is due.
+            auto wait = std::chrono::nanoseconds(
+                    static_cast<uint64_t>((needed - limit_tokens) * 1e9 / limit_rate) + 1);
+            limit_cv->wait_for(lock, wait);
+        }
+        limit_waiting[prio]--;
+    }
+}
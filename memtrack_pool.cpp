@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * Idle handles are kept in a per-thread list of up to kThreadCacheSize
+ * handles, and beyond that in a list shared by all threads.  A thread caches
+ * handles for the last pool it used only; switching pools moves its handles
+ * to the shared list of the previous pool.
+ *
+ * The pool state is reference counted so that thread caches can outlive
+ * memtrack_pool_destroy: handles cached for a destroyed pool are freed when
+ * their thread exits or switches pools.
+ */
+static constexpr size_t kThreadCacheSize = 16;
+
+namespace {
+
+struct PoolState {
+    explicit PoolState(size_t max_retained) : max_retained(max_retained) {}
+    ~PoolState() {
+        for (memtrack_proc* p : shared) {
+            memtrack_proc_destroy(p);
+        }
+    }
+
+    const size_t max_retained;
+    std::atomic<size_t> retained{0};
+    std::atomic<bool> destroyed{false};
+    std::mutex lock;
+    std::vector<memtrack_proc*> shared;
+};
+
+struct ThreadCache {
+    ~ThreadCache() { flush(); }
+
+    /* Hand the cached handles back to the shared list of their pool. */
+    void flush() {
+        if (!state) {
+            return;
+        }
+        if (state->destroyed.load(std::memory_order_acquire)) {
+            for (memtrack_proc* p : handles) {
+                memtrack_proc_destroy(p);
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(state->lock);
+            state->shared.insert(state->shared.end(), handles.begin(), handles.end());
+        }
+        handles.clear();
+        state.reset();
+    }
+
+    std::shared_ptr<PoolState> state;
+    std::vector<memtrack_proc*> handles;
+};
+
+}  // namespace
+
+struct memtrack_pool {
+    std::shared_ptr<PoolState> state;
+};
+
+static thread_local ThreadCache thread_cache;
+
+static size_t handle_size(const memtrack_proc* p) {
+    size_t size = sizeof(*p);
+    for (const auto& type : p->types) {
+        size += type.records.capacity() * sizeof(MemtrackRecord);
+    }
+    return size;
+}
+
+memtrack_pool* memtrack_pool_new(size_t max_retained_bytes) {
+    return new memtrack_pool{std::make_shared<PoolState>(max_retained_bytes)};
+}
+
+void memtrack_pool_destroy(memtrack_pool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    PoolState* state = pool->state.get();
+    {
+        std::lock_guard<std::mutex> lock(state->lock);
+        state->destroyed.store(true, std::memory_order_release);
+        for (memtrack_proc* p : state->shared) {
+            memtrack_proc_destroy(p);
+        }
+        state->shared.clear();
+    }
+    if (thread_cache.state.get() == state) {
+        thread_cache.flush();
+    }
+    delete pool;
+}
+
+memtrack_proc* memtrack_pool_get(memtrack_pool* pool) {
+    if (!pool) {
+        return nullptr;
+    }
+
+    PoolState* state = pool->state.get();
+    memtrack_proc* p = nullptr;
+    if (thread_cache.state.get() == state && !thread_cache.handles.empty()) {
+        p = thread_cache.handles.back();
+        thread_cache.handles.pop_back();
+    } else {
+        std::lock_guard<std::mutex> lock(state->lock);
+        if (!state->shared.empty()) {
+            p = state->shared.back();
+            state->shared.pop_back();
+        }
+    }
+
+    if (!p) {
+        return memtrack_proc_new();
+    }
+    state->retained.fetch_sub(handle_size(p), std::memory_order_relaxed);
+    return p;
+}
+
+void memtrack_pool_put(memtrack_pool* pool, memtrack_proc* p) {
+    if (!p) {
+        return;
+    }
+
+    PoolState* state = pool ? pool->state.get() : nullptr;
+    size_t size = handle_size(p);
+    if (!state || state->retained.fetch_add(size, std::memory_order_relaxed) + size >
+                          state->max_retained) {
+        if (state) {
+            state->retained.fetch_sub(size, std::memory_order_relaxed);
+        }
+        memtrack_proc_destroy(p);
+        return;
+    }
+
+    if (thread_cache.state.get() != state) {
+        thread_cache.flush();
+        thread_cache.state = pool->state;
+    }
+    if (thread_cache.handles.size() < kThreadCacheSize) {
+        thread_cache.handles.push_back(p);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(state->lock);
+    state->shared.push_back(p);
+}
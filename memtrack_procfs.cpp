@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/parseint.h>
+#include <android-base/unique_fd.h>
+
+uint64_t memtrack_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/* From include/linux/sched.h, set in the flags field of /proc/<pid>/stat. */
+static constexpr unsigned long kPfKthread = 0x00200000;
+
+/*
+ * Return true if pid, whose directory is under dir_fd, is a kernel thread.
+ * Only the flags field of stat is trusted: an empty cmdline is also what a
+ * zombie or a process that cleared its argv looks like.
+ */
+static bool is_kernel_thread(int dir_fd, pid_t pid) {
+    char path[32];
+    snprintf(path, sizeof(path), "%d/stat", pid);
+    ::android::base::unique_fd fd(openat(dir_fd, path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+
+    char buf[1024];
+    ssize_t len = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf) - 1));
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+
+    // flags is field 9, the 7th after comm.
+    const char* p = strrchr(buf, ')');
+    for (int field = 0; p && field < 7; field++) {
+        p = strchr(p + 1, ' ');
+    }
+    return p && (strtoul(p + 1, nullptr, 10) & kPfKthread);
+}
+
+int memtrack_list_pids(std::vector<pid_t>* pids, const char* proc_root, bool skip_kthreads) {
+    ::android::base::unique_fd dir_fd(open(proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (dir_fd < 0) {
+        return -errno;
+    }
+
+    // getdents64 straight into a stack buffer: unlike readdir() this needs no
+    // DIR allocation, and one call returns a few hundred entries.
+    alignas(struct dirent64) char buf[8192];
+    size_t first = pids->size();
+    for (;;) {
+        long len = syscall(__NR_getdents64, dir_fd.get(), buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (len == 0) {
+            break;
+        }
+
+        for (long off = 0; off < len;) {
+            auto de = reinterpret_cast<struct dirent64*>(buf + off);
+            off += de->d_reclen;
+
+            pid_t pid;
+            if (de->d_type != DT_DIR || !::android::base::ParseInt(de->d_name, &pid, 1)) {
+                continue;
+            }
+            if (skip_kthreads && is_kernel_thread(dir_fd, pid)) {
+                continue;
+            }
+            pids->push_back(pid);
+        }
+    }
+    // /proc lists pids in ascending order already; sort in case another
+    // proc_root does not.
+    if (!std::is_sorted(pids->begin() + first, pids->end())) {
+        std::sort(pids->begin() + first, pids->end());
+    }
+    return 0;
+}
+
+ssize_t memtrack_list_processes(pid_t* pids, size_t count, uint32_t flags) {
+    if (!pids && count) {
+        return -EINVAL;
+    }
+
+    // Reused across calls so that sampling in a loop does not allocate.
+    static thread_local std::vector<pid_t> all;
+    all.clear();
+    if (memtrack_replaying()) {
+        memtrack_replay_list_pids(&all);
+    } else {
+        int ret = memtrack_list_pids(&all, "/proc", flags & MEMTRACK_LIST_SKIP_KTHREADS);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    std::copy_n(all.begin(), std::min(count, all.size()), pids);
+    return all.size();
+}
+
+ssize_t memtrack_read_proc_file(pid_t pid, const char* name, char* buf, size_t size,
+                                const char* proc_root) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%d/%s", proc_root, pid, name);
+    ::android::base::unique_fd fd(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return -errno;
+    }
+
+    ssize_t len = TEMP_FAILURE_RETRY(read(fd, buf, size - 1));
+    if (len < 0) {
+        return -errno;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+int memtrack_read_start_time(pid_t pid, uint64_t* start_time, const char* proc_root) {
+    // Large enough for any stat line; only comm is of variable length and it
+    // is capped at 16 bytes.
+    char buf[1024];
+    ssize_t ret = memtrack_read_proc_file(pid, "stat", buf, sizeof(buf), proc_root);
+    if (ret < 0) {
+        return ret;
+    }
+
+    // comm may contain spaces and parentheses, so fields are counted from
+    // the last ')'.  starttime is field 22, the 20th after comm.
+    const char* p = strrchr(buf, ')');
+    if (!p) {
+        return -EINVAL;
+    }
+    for (int field = 0; field < 20; field++) {
+        p = strchr(p + 1, ' ');
+        if (!p) {
+            return -EINVAL;
+        }
+    }
+
+    char* end;
+    *start_time = strtoull(p + 1, &end, 10);
+    return end == p + 1 ? -EINVAL : 0;
+}
+
+const char* memtrack_find_field(const char* buf, const char* key) {
+    size_t len = strlen(key);
+    for (const char* line = buf; line && *line;) {
+        if (!strncmp(line, key, len)) {
+            return line + len;
+        }
+        line = strchr(line, '\n');
+        if (line) {
+            line++;
+        }
+    }
+    return nullptr;
+}
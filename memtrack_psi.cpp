@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <new>
+
+#include <android-base/unique_fd.h>
+
+/*
+ * A PSI trigger is armed by writing "<some|full> <stall us> <window us>" to
+ * /proc/pressure/memory; the kernel then signals POLLPRI on that fd whenever
+ * tasks stalled on memory for stall us within a window, at most once per
+ * window.  The kernel accepts windows of 500ms to 10s.
+ */
+static constexpr const char* kPsiMemoryPath = "/proc/pressure/memory";
+static constexpr unsigned int kMinWindowMs = 500;
+static constexpr unsigned int kMaxWindowMs = 10000;
+
+struct memtrack_psi_trigger {
+    ::android::base::unique_fd fd;
+    uint64_t min_interval_ns;
+    uint64_t last_ns;
+};
+
+memtrack_psi_trigger* memtrack_psi_trigger_new(unsigned int stall_ms, unsigned int window_ms,
+                                               int full, unsigned int min_interval_ms) {
+    if (stall_ms == 0 || stall_ms >= window_ms || window_ms < kMinWindowMs ||
+        window_ms > kMaxWindowMs) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    ::android::base::unique_fd fd(open(kPsiMemoryPath, O_RDWR | O_NONBLOCK | O_CLOEXEC));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%s %u %u", full ? "full" : "some", stall_ms * 1000,
+                       window_ms * 1000);
+    // The trigger is armed by a single write including the terminating NUL.
+    if (TEMP_FAILURE_RETRY(write(fd, buf, len + 1)) < 0) {
+        return nullptr;
+    }
+
+    memtrack_psi_trigger* t = new (std::nothrow) memtrack_psi_trigger();
+    if (!t) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    t->fd = std::move(fd);
+    t->min_interval_ns = static_cast<uint64_t>(min_interval_ms) * 1000000ULL;
+    return t;
+}
+
+void memtrack_psi_trigger_destroy(memtrack_psi_trigger* t) {
+    delete t;
+}
+
+int memtrack_psi_trigger_fd(memtrack_psi_trigger* t) {
+    return t ? t->fd.get() : -EINVAL;
+}
+
+int memtrack_psi_trigger_wait(memtrack_psi_trigger* t, int timeout_ms) {
+    if (!t) {
+        return -EINVAL;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = t->fd;
+    pfd.events = POLLPRI;
+    pfd.revents = 0;
+    int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout_ms));
+    if (ret < 0) {
+        return -errno;
+    }
+    if (ret == 0) {
+        return 0;
+    }
+    if (pfd.revents & POLLERR) {
+        // The pressure interface went away.
+        return -ENODEV;
+    }
+
+    // Events that come faster than the minimum interval are folded into one
+    // returned at the end of the interval.
+    uint64_t now = memtrack_now_ns();
+    if (t->last_ns && now - t->last_ns < t->min_interval_ns) {
+        uint64_t delay = t->min_interval_ns - (now - t->last_ns);
+        struct timespec ts;
+        ts.tv_sec = delay / 1000000000;
+        ts.tv_nsec = delay % 1000000000;
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+        }
+        now = memtrack_now_ns();
+    }
+    t->last_ns = now;
+    return 1;
+}
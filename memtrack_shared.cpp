@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+/*
+ * A refresh queries into a private memtrack_proc, then writes the totals to
+ * the buffer readers are not directed to and flips front to it.  Each buffer
+ * is also protected by a sequence lock, so a reader that is overtaken by two
+ * refreshes while it copies notices and retries instead of returning a torn
+ * copy.  Readers never block on a refresh in progress; one that keeps
+ * losing the race yields between attempts and gives up after
+ * kSharedReadRetries of them.
+ */
+static constexpr int kSharedReadRetries = 1000;
+
+struct memtrack_shared_buffer {
+    std::atomic<uint32_t> seq;
+    memtrack_proc_totals totals;
+};
+
+struct memtrack_shared_proc {
+    std::mutex refresh_lock;
+    memtrack_proc* back;
+    std::atomic<uint32_t> front;
+    memtrack_shared_buffer buffers[2];
+};
+
+memtrack_shared_proc* memtrack_shared_proc_new(void) {
+    memtrack_proc* back = memtrack_proc_new();
+    if (!back) {
+        return nullptr;
+    }
+    memtrack_shared_proc* s = new (std::nothrow) memtrack_shared_proc();
+    if (!s) {
+        memtrack_proc_destroy(back);
+        errno = ENOMEM;
+        return nullptr;
+    }
+    s->back = back;
+    return s;
+}
+
+void memtrack_shared_proc_destroy(memtrack_shared_proc* s) {
+    if (s) {
+        memtrack_proc_destroy(s->back);
+        delete s;
+    }
+}
+
+int memtrack_shared_proc_refresh(memtrack_shared_proc* s, pid_t pid) {
+    if (!s) {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(s->refresh_lock);
+    int ret = memtrack_proc_get(s->back, pid);
+    if (ret != 0) {
+        return ret;
+    }
+
+    uint32_t front = s->front.load(std::memory_order_relaxed);
+    memtrack_shared_buffer* b = &s->buffers[front ^ 1];
+
+    memtrack_proc_totals totals;
+    totals.pid = pid;
+    totals.generation = s->buffers[front].totals.generation + 1;
+    totals.valid_types = memtrack_proc_valid_types(s->back);
+    totals.graphics_total = memtrack_proc_graphics_total(s->back);
+    totals.graphics_pss = memtrack_proc_graphics_pss(s->back);
+    totals.gl_total = memtrack_proc_gl_total(s->back);
+    totals.gl_pss = memtrack_proc_gl_pss(s->back);
+    totals.other_total = memtrack_proc_other_total(s->back);
+    totals.other_pss = memtrack_proc_other_pss(s->back);
+
+    uint32_t seq = b->seq.load(std::memory_order_relaxed);
+    b->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&b->totals, &totals, sizeof(totals));
+    b->seq.store(seq + 2, std::memory_order_release);
+
+    s->front.store(front ^ 1, std::memory_order_release);
+    return 0;
+}
+
+int memtrack_shared_proc_read(memtrack_shared_proc* s, memtrack_proc_totals* totals) {
+    if (!s || !totals) {
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < kSharedReadRetries; i++) {
+        const memtrack_shared_buffer* b = &s->buffers[s->front.load(std::memory_order_acquire)];
+        uint32_t seq = b->seq.load(std::memory_order_acquire);
+        if (seq == 0) {
+            return -ENODATA;
+        }
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(totals, &b->totals, sizeof(*totals));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (b->seq.load(std::memory_order_relaxed) == seq) {
+            return 0;
+        }
+        sched_yield();
+    }
+    return -EAGAIN;
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+
+#include <android-base/unique_fd.h>
+
+/*
+ * The region is a header followed by an array of entries, protected by a
+ * sequence lock: the writer makes seq odd while it updates the region and
+ * even again when it is done, and readers retry any copy that overlapped a
+ * change of seq.  time_ns is 0 until the first snapshot is published.
+ *
+ * The layout is fixed so that 32-bit and 64-bit processes agree on it:
+ * struct memtrack_snapshot_entry starts with a pid_t and is padded
+ * differently by each ABI, so entries are copied to and from a wire struct
+ * with explicit padding.
+ *
+ * A restarted writer reuses the file in place, continuing seq so that no
+ * reader mid-copy mistakes a reinitialized region for a consistent one, and
+ * only ever grows it, so that readers still mapping the old size don't
+ * fault.  It bumps session, and readers that see session change remap the
+ * file to pick up its new size.  Readers never trust the header further
+ * than their own mapping.
+ */
+static constexpr uint32_t kShmMagic = 0x4b52544d;  // "MTRK"
+static constexpr uint32_t kShmVersion = 3;
+static constexpr int kShmReadRetries = 1000;
+
+struct memtrack_shm_entry {
+    int32_t pid;
+    uint32_t reserved;
+    uint64_t start_time;
+    uint64_t graphics_total;
+    uint64_t graphics_pss;
+    uint64_t gl_total;
+    uint64_t gl_pss;
+    uint64_t other_total;
+    uint64_t other_pss;
+};
+
+static_assert(sizeof(memtrack_shm_entry) == 64, "shm entry layout changed");
+static_assert(offsetof(memtrack_shm_entry, start_time) == 8, "shm entry layout changed");
+static_assert(offsetof(memtrack_shm_entry, other_pss) == 56, "shm entry layout changed");
+
+struct memtrack_shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    std::atomic<uint32_t> seq;
+    uint32_t count;
+    uint64_t time_ns;
+    uint64_t session;
+    memtrack_shm_entry entries[];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seq must be usable across processes");
+static_assert(sizeof(std::atomic<uint32_t>) == 4, "shm header layout changed");
+static_assert(sizeof(memtrack_shm_header) == 40, "shm header layout changed");
+static_assert(offsetof(memtrack_shm_header, seq) == 16, "shm header layout changed");
+static_assert(offsetof(memtrack_shm_header, session) == 32, "shm header layout changed");
+
+struct memtrack_shm_writer {
+    memtrack_shm_header* hdr;
+    size_t size;
+};
+
+struct memtrack_shm_reader {
+    std::string path;
+    const memtrack_shm_header* hdr;
+    size_t size;
+    uint64_t session;
+};
+
+static size_t shm_size(size_t capacity) {
+    return sizeof(memtrack_shm_header) + capacity * sizeof(memtrack_shm_entry);
+}
+
+memtrack_shm_writer* memtrack_shm_writer_create(const char* path, size_t max_entries) {
+    if (!path || max_entries == 0) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    ::android::base::unique_fd fd(open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return nullptr;
+    }
+    size_t old_size = st.st_size;
+    size_t size = std::max(shm_size(max_entries), old_size);
+    if (size != old_size && ftruncate(fd, size) < 0) {
+        return nullptr;
+    }
+
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto hdr = static_cast<memtrack_shm_header*>(addr);
+    uint32_t seq = 0;
+    uint64_t session = 0;
+    if (old_size >= sizeof(memtrack_shm_header) && hdr->magic == kShmMagic &&
+        hdr->version == kShmVersion) {
+        // Keep seq moving forward; an odd value left by a writer that died
+        // mid-publish is rounded up.
+        seq = (hdr->seq.load(std::memory_order_relaxed) + 1) & ~1u;
+        session = hdr->session;
+    }
+    hdr->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    hdr->version = kShmVersion;
+    hdr->capacity = (size - sizeof(memtrack_shm_header)) / sizeof(memtrack_shm_entry);
+    hdr->count = 0;
+    hdr->time_ns = 0;
+    hdr->session = session + 1;
+    hdr->magic = kShmMagic;
+    hdr->seq.store(seq + 2, std::memory_order_release);
+
+    return new memtrack_shm_writer{hdr, size};
+}
+
+void memtrack_shm_writer_destroy(memtrack_shm_writer* w) {
+    if (w) {
+        munmap(w->hdr, w->size);
+        delete w;
+    }
+}
+
+int memtrack_shm_publish(memtrack_shm_writer* w, memtrack_snapshot* s) {
+    if (!w || !s) {
+        return -EINVAL;
+    }
+
+    memtrack_shm_header* hdr = w->hdr;
+    size_t count = std::min<size_t>(s->entries.size(), hdr->capacity);
+
+    uint32_t seq = hdr->seq.load(std::memory_order_relaxed);
+    hdr->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    hdr->count = count;
+    hdr->time_ns = s->time_ns;
+    for (size_t i = 0; i < count; i++) {
+        const memtrack_snapshot_entry& e = s->entries[i];
+        memtrack_shm_entry* out = &hdr->entries[i];
+        out->pid = e.pid;
+        out->reserved = 0;
+        out->start_time = e.start_time;
+        out->graphics_total = e.graphics_total;
+        out->graphics_pss = e.graphics_pss;
+        out->gl_total = e.gl_total;
+        out->gl_pss = e.gl_pss;
+        out->other_total = e.other_total;
+        out->other_pss = e.other_pss;
+    }
+
+    hdr->seq.store(seq + 2, std::memory_order_release);
+    return 0;
+}
+
+/* Map the file at r->path, replacing any previous mapping.  Returns 0 or -errno. */
+static int shm_map(memtrack_shm_reader* r) {
+    ::android::base::unique_fd fd(open(r->path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return -errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return -errno;
+    }
+    if (static_cast<size_t>(st.st_size) < sizeof(memtrack_shm_header)) {
+        return -EINVAL;
+    }
+
+    size_t size = st.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return -errno;
+    }
+
+    auto hdr = static_cast<const memtrack_shm_header*>(addr);
+    if (hdr->magic != kShmMagic || hdr->version != kShmVersion) {
+        munmap(addr, size);
+        return -EINVAL;
+    }
+
+    if (r->hdr) {
+        munmap(const_cast<memtrack_shm_header*>(r->hdr), r->size);
+    }
+    r->hdr = hdr;
+    r->size = size;
+    r->session = hdr->session;
+    return 0;
+}
+
+memtrack_shm_reader* memtrack_shm_reader_open(const char* path) {
+    if (!path) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    memtrack_shm_reader* r = new (std::nothrow) memtrack_shm_reader{path, nullptr, 0, 0};
+    if (!r) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    int ret = shm_map(r);
+    if (ret < 0) {
+        delete r;
+        errno = -ret;
+        return nullptr;
+    }
+    return r;
+}
+
+void memtrack_shm_reader_close(memtrack_shm_reader* r) {
+    if (r) {
+        munmap(const_cast<memtrack_shm_header*>(r->hdr), r->size);
+        delete r;
+    }
+}
+
+int memtrack_shm_read(memtrack_shm_reader* r, memtrack_snapshot* s) {
+    if (!r || !s) {
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < kShmReadRetries; i++) {
+        const memtrack_shm_header* hdr = r->hdr;
+        uint32_t seq = hdr->seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+
+        if (hdr->session != r->session) {
+            // The writer restarted, and may have grown the file.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (hdr->seq.load(std::memory_order_relaxed) != seq) {
+                continue;
+            }
+            int ret = shm_map(r);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+
+        uint64_t time_ns = hdr->time_ns;
+        size_t count = std::min<size_t>(
+                hdr->count, (r->size - sizeof(memtrack_shm_header)) / sizeof(memtrack_shm_entry));
+        s->entries.resize(count);
+        s->uids.clear();
+        s->cgroups.clear();
+        s->dmabufs.clear();
+        s->dmabuf_total = 0;
+        for (size_t j = 0; j < count; j++) {
+            const memtrack_shm_entry& in = hdr->entries[j];
+            memtrack_snapshot_entry* e = &s->entries[j];
+            e->pid = in.pid;
+            e->start_time = in.start_time;
+            e->graphics_total = in.graphics_total;
+            e->graphics_pss = in.graphics_pss;
+            e->gl_total = in.gl_total;
+            e->gl_pss = in.gl_pss;
+            e->other_total = in.other_total;
+            e->other_pss = in.other_pss;
+        }
+        s->time_ns = time_ns;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (hdr->seq.load(std::memory_order_relaxed) == seq) {
+            return time_ns ? 0 : -ENODATA;
+        }
+    }
+
+    return -EAGAIN;
+}
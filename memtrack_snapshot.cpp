@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+static constexpr size_t kProcFileBufSize = 4096;
+
+static bool read_uid(pid_t pid, char* buf, size_t size, uid_t* uid) {
+    if (memtrack_read_proc_file(pid, "status", buf, size) < 0) {
+        return false;
+    }
+
+    const char* line = strstr(buf, "\nUid:");
+    if (!line) {
+        return false;
+    }
+    *uid = strtoul(line + strlen("\nUid:"), nullptr, 10);
+    return true;
+}
+
+/*
+ * Find the cpuset controller path in /proc/<pid>/cgroup, falling back to the
+ * unified hierarchy ("0::") path when there is no cpuset v1 controller.
+ */
+static bool read_cgroup(pid_t pid, char* buf, size_t size, const char** path, size_t* len) {
+    if (memtrack_read_proc_file(pid, "cgroup", buf, size) < 0) {
+        return false;
+    }
+
+    const char* unified = nullptr;
+    for (char* line = buf; *line;) {
+        char* end = strchrnul(line, '\n');
+        char* controllers = strchr(line, ':');
+        char* cgroup = controllers ? strchr(controllers + 1, ':') : nullptr;
+        if (cgroup && cgroup < end) {
+            if (!strncmp(controllers + 1, "cpuset:", strlen("cpuset:"))) {
+                *path = cgroup + 1;
+                *len = end - *path;
+                return true;
+            }
+            if (controllers == line + 1 && line[0] == '0' && cgroup == controllers + 1) {
+                unified = cgroup + 1;
+                *len = end - unified;
+            }
+        }
+        line = *end ? end + 1 : end;
+    }
+
+    *path = unified;
+    return unified != nullptr;
+}
+
+/* FNV-1a, used to key cgroup paths in the group index. */
+static uint64_t hash_path(const char* path, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ static_cast<uint8_t>(path[i])) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* Add v to *sum, saturating at UINT64_MAX like the per-process sums. */
+static void add_saturating(uint64_t* sum, uint64_t v) {
+    if (__builtin_add_overflow(*sum, v, sum)) {
+        *sum = UINT64_MAX;
+    }
+}
+
+static void add_to_group(memtrack_snapshot_group* g, const memtrack_snapshot_entry& e) {
+    g->nr_procs++;
+    add_saturating(&g->graphics_total, e.graphics_total);
+    add_saturating(&g->graphics_pss, e.graphics_pss);
+    add_saturating(&g->gl_total, e.gl_total);
+    add_saturating(&g->gl_pss, e.gl_pss);
+    add_saturating(&g->other_total, e.other_total);
+    add_saturating(&g->other_pss, e.other_pss);
+}
+
+static void add_to_uid_group(memtrack_snapshot* s, uid_t uid, const memtrack_snapshot_entry& e) {
+    auto [index, inserted] = s->uid_index.insert(uid);
+    if (inserted) {
+        *index = s->uids.size();
+        s->uids.emplace_back();
+        s->uids.back().id = uid;
+    }
+    add_to_group(&s->uids[*index], e);
+}
+
+static void add_to_cgroup_group(memtrack_snapshot* s, const char* path, size_t len,
+                                const memtrack_snapshot_entry& e) {
+    // Probe from the path hash until the path or a free key is found, so
+    // that colliding hashes still get groups of their own.
+    for (uint64_t key = hash_path(path, len);; key++) {
+        auto [index, inserted] = s->cgroup_index.insert(key);
+        if (inserted) {
+            *index = s->cgroups.size();
+            s->cgroups.emplace_back();
+            s->cgroups.back().id = *index;
+            if (s->cgroup_paths.size() <= *index) {
+                s->cgroup_paths.emplace_back();
+            }
+            s->cgroup_paths[*index].assign(path, len);
+        } else if (s->cgroup_paths[*index].compare(0, std::string::npos, path, len) != 0) {
+            continue;
+        }
+        add_to_group(&s->cgroups[*index], e);
+        return;
+    }
+}
+
+/*
+ * Add a new entry to its groups.  The uid and cgroup are read after the
+ * entry's start time, and only used if the start time still matches, so a
+ * pid recycled in between never lends the new process's groups to the old
+ * one's stats.
+ */
+static void group_entry(memtrack_snapshot* s, const memtrack_snapshot_entry& e) {
+    uid_t uid;
+    bool by_uid = (s->grouping & MEMTRACK_SNAPSHOT_GROUP_UID) &&
+                  read_uid(e.pid, s->buf.data(), s->buf.size(), &uid);
+    const char* path = nullptr;
+    size_t len = 0;
+    bool by_cgroup = (s->grouping & MEMTRACK_SNAPSHOT_GROUP_CGROUP) &&
+                     read_cgroup(e.pid, s->buf.data(), s->buf.size(), &path, &len);
+
+    uint64_t start_time;
+    if (e.start_time == 0 || memtrack_read_start_time(e.pid, &start_time) < 0 ||
+        start_time != e.start_time) {
+        return;
+    }
+    if (by_uid) {
+        add_to_uid_group(s, uid, e);
+    }
+    if (by_cgroup) {
+        add_to_cgroup_group(s, path, len, e);
+    }
+}
+
+/*
+ * The dma-buf index records one reference per (process, buffer) while the
+ * processes are swept, counting the sharers of each buffer.  Shares are
+ * computed from the recorded references once the sweep is done, so procfs
+ * is read only once per process.
+ */
+static void scan_dmabufs(memtrack_snapshot* s, pid_t pid) {
+    s->dmabuf_pid_bufs.clear();
+    if (s->dmabuf_scanner->scan(pid, &s->dmabuf_pid_bufs) < 0 ||
+        s->dmabuf_pid_bufs.size() == 0) {
+        return;
+    }
+
+    uint32_t process = s->dmabufs.size();
+    s->dmabufs.push_back({pid, 0, 0});
+    s->dmabuf_pid_bufs.for_each([s, process](uint64_t inode, uint64_t size) {
+        auto [buf, inserted] = s->dmabuf_bufs.insert(inode);
+        if (inserted) {
+            buf->size = size;
+            add_saturating(&s->dmabuf_total, size);
+        }
+        buf->sharers++;
+        s->dmabuf_refs.push_back({process, inode});
+    });
+}
+
+static void charge_dmabufs(memtrack_snapshot* s) {
+    for (const auto& ref : s->dmabuf_refs) {
+        const memtrack_dmabuf_index_entry* buf = s->dmabuf_bufs.find(ref.inode);
+        memtrack_snapshot_dmabuf& d = s->dmabufs[ref.process];
+        add_saturating(&d.rss, buf->size);
+        add_saturating(&d.pss, buf->size / buf->sharers);
+    }
+}
+
+/*
+ * A process that reported no memory for kZeroStreak sweeps in a row is only
+ * queried again every zero_probe_every sweeps, and on every full sweep.  Its
+ * start time is checked on each sweep so a recycled pid is never skipped.
+ */
+static constexpr uint32_t kZeroStreak = 2;
+
+static bool skip_zero_pid(memtrack_snapshot* s, pid_t pid, memtrack_zero_pid* zero, bool full) {
+    zero->seen = s->sweep;
+    if (full || zero->streak < kZeroStreak || s->sweep - zero->probed >= s->zero_probe_every) {
+        return false;
+    }
+
+    uint64_t start_time;
+    if (memtrack_read_start_time(pid, &start_time) < 0 || start_time != zero->start_time) {
+        zero->streak = 0;
+        return false;
+    }
+    return true;
+}
+
+static void note_zero_pid(memtrack_snapshot* s, pid_t pid, memtrack_zero_pid* zero) {
+    uint64_t start_time;
+    if (memtrack_read_start_time(pid, &start_time) < 0) {
+        return;
+    }
+
+    if (!zero) {
+        zero = s->zero_pids.insert(pid).first;
+    }
+    if (zero->start_time != start_time) {
+        zero->start_time = start_time;
+        zero->streak = 0;
+    }
+    zero->streak++;
+    zero->probed = s->sweep;
+    zero->seen = s->sweep;
+}
+
+/* Forget processes that are no longer listed in /proc. */
+static void prune_zero_pids(memtrack_snapshot* s) {
+    s->stale_pids.clear();
+    s->zero_pids.for_each([s](uint64_t pid, const memtrack_zero_pid& zero) {
+        if (zero.seen != s->sweep) {
+            s->stale_pids.push_back(pid);
+        }
+    });
+    for (uint64_t pid : s->stale_pids) {
+        s->zero_pids.erase(pid);
+    }
+}
+
+memtrack_snapshot* memtrack_snapshot_new(void) {
+    memtrack_proc* proc = memtrack_proc_new();
+    if (!proc) {
+        return nullptr;
+    }
+    memtrack_snapshot* s = new memtrack_snapshot();
+    s->proc = proc;
+    return s;
+}
+
+void memtrack_snapshot_destroy(memtrack_snapshot* s) {
+    if (s) {
+        memtrack_proc_destroy(s->proc);
+        delete s;
+    }
+}
+
+int memtrack_snapshot_take(memtrack_snapshot* s) {
+    if (!s) {
+        return -EINVAL;
+    }
+
+    s->pids.clear();
+    // Kernel threads never own memory tracked by memtrack.
+    int ret = memtrack_list_pids(&s->pids, "/proc", true);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->time_ns = memtrack_now_ns();
+    s->entries.clear();
+    s->uids.clear();
+    s->cgroups.clear();
+    if (s->grouping) {
+        s->buf.resize(kProcFileBufSize);
+        s->uid_index.clear();
+        s->cgroup_index.clear();
+    }
+    s->dmabuf_total = 0;
+    s->dmabufs.clear();
+    if (s->dmabuf_index) {
+        if (!s->dmabuf_scanner) {
+            s->dmabuf_scanner = std::make_unique<MemtrackDmabufScanner>("/proc");
+        }
+        s->dmabuf_bufs.clear();
+        s->dmabuf_refs.clear();
+    }
+    s->sweep++;
+    s->skipped = 0;
+    bool full = s->zero_full_every && s->sweep % s->zero_full_every == 0;
+
+    int err = 0;
+    bool any = false;
+    for (pid_t pid : s->pids) {
+        // Scanning dma-bufs only reads procfs, so skipped processes are
+        // scanned too and the index stays complete.
+        if (s->dmabuf_index) {
+            scan_dmabufs(s, pid);
+        }
+        memtrack_zero_pid* zero = s->zero_probe_every ? s->zero_pids.find(pid) : nullptr;
+        if (zero && skip_zero_pid(s, pid, zero, full)) {
+            s->skipped++;
+            any = true;
+            continue;
+        }
+
+        ret = memtrack_proc_get(s->proc, pid);
+        if (ret != 0) {
+            // The process may have exited since /proc was listed.
+            err = ret;
+            continue;
+        }
+        any = true;
+
+        memtrack_snapshot_entry e;
+        e.pid = pid;
+        // Every type succeeded, so the only possible error is a saturated
+        // sum, which is kept as UINT64_MAX.
+        memtrack_proc_graphics_total_u64(s->proc, &e.graphics_total);
+        memtrack_proc_graphics_pss_u64(s->proc, &e.graphics_pss);
+        memtrack_proc_gl_total_u64(s->proc, &e.gl_total);
+        memtrack_proc_gl_pss_u64(s->proc, &e.gl_pss);
+        memtrack_proc_other_total_u64(s->proc, &e.other_total);
+        memtrack_proc_other_pss_u64(s->proc, &e.other_pss);
+        if (!(e.graphics_total | e.graphics_pss | e.gl_total | e.gl_pss | e.other_total |
+              e.other_pss)) {
+            if (s->zero_probe_every) {
+                note_zero_pid(s, pid, zero);
+            }
+            continue;
+        }
+        if (zero) {
+            s->zero_pids.erase(pid);
+        }
+        // Only processes with memory are kept, so only they pay for reading
+        // their identity.
+        if (memtrack_read_start_time(pid, &e.start_time) < 0) {
+            e.start_time = 0;
+        }
+        s->entries.push_back(e);
+        if (s->grouping) {
+            group_entry(s, e);
+        }
+    }
+
+    if (s->zero_probe_every) {
+        prune_zero_pids(s);
+    }
+    if (!any) {
+        s->dmabuf_total = 0;
+        s->dmabufs.clear();
+        return err;
+    }
+
+    std::sort(s->uids.begin(), s->uids.end(),
+              [](const auto& a, const auto& b) { return a.id < b.id; });
+    if (s->dmabuf_index) {
+        charge_dmabufs(s);
+    }
+    return 0;
+}
+
+uint64_t memtrack_snapshot_time_ns(memtrack_snapshot* s) {
+    return s ? s->time_ns : 0;
+}
+
+size_t memtrack_snapshot_count(memtrack_snapshot* s) {
+    return s ? s->entries.size() : 0;
+}
+
+const memtrack_snapshot_entry* memtrack_snapshot_entries(memtrack_snapshot* s) {
+    return s ? s->entries.data() : nullptr;
+}
+
+const memtrack_snapshot_entry* memtrack_snapshot_find(memtrack_snapshot* s,
+                                                     const memtrack_proc_id* id) {
+    if (!s || !id) {
+        return nullptr;
+    }
+
+    auto it = std::lower_bound(s->entries.begin(), s->entries.end(), id->pid,
+                               [](const auto& e, pid_t pid) { return e.pid < pid; });
+    if (it == s->entries.end() || it->pid != id->pid) {
+        return nullptr;
+    }
+    if (id->start_time != 0 && it->start_time != id->start_time) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+void memtrack_snapshot_set_grouping(memtrack_snapshot* s, uint32_t flags) {
+    if (s) {
+        s->grouping = flags;
+    }
+}
+
+size_t memtrack_snapshot_uid_count(memtrack_snapshot* s) {
+    return s ? s->uids.size() : 0;
+}
+
+const memtrack_snapshot_group* memtrack_snapshot_uids(memtrack_snapshot* s) {
+    return s ? s->uids.data() : nullptr;
+}
+
+size_t memtrack_snapshot_cgroup_count(memtrack_snapshot* s) {
+    return s ? s->cgroups.size() : 0;
+}
+
+const memtrack_snapshot_group* memtrack_snapshot_cgroups(memtrack_snapshot* s) {
+    return s ? s->cgroups.data() : nullptr;
+}
+
+const char* memtrack_snapshot_cgroup_path(memtrack_snapshot* s, uint64_t id) {
+    if (!s || id >= s->cgroups.size()) {
+        return nullptr;
+    }
+    return s->cgroup_paths[id].c_str();
+}
+
+void memtrack_snapshot_set_dmabuf_index(memtrack_snapshot* s, int enable) {
+    if (s) {
+        s->dmabuf_index = enable != 0;
+    }
+}
+
+uint64_t memtrack_snapshot_dmabuf_total(memtrack_snapshot* s) {
+    return s ? s->dmabuf_total : 0;
+}
+
+size_t memtrack_snapshot_dmabuf_count(memtrack_snapshot* s) {
+    return s ? s->dmabufs.size() : 0;
+}
+
+const memtrack_snapshot_dmabuf* memtrack_snapshot_dmabufs(memtrack_snapshot* s) {
+    return s ? s->dmabufs.data() : nullptr;
+}
+
+void memtrack_snapshot_set_zero_skip(memtrack_snapshot* s, unsigned int probe_every,
+                                     unsigned int full_every) {
+    if (s) {
+        s->zero_probe_every = probe_every;
+        s->zero_full_every = full_every;
+        s->zero_pids.clear();
+    }
+}
+
+size_t memtrack_snapshot_skipped(memtrack_snapshot* s) {
+    return s ? s->skipped : 0;
+}
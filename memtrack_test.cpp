@@ -14,12 +14,22 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <malloc.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 
-#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
 #include <vector>
 
 #include <android-base/file.h>
@@ -27,71 +37,420 @@
 #include <android-base/stringprintf.h>
 #include <memtrack/memtrack.h>
 
-#define DIV_ROUND_UP(x, y) (((x) + (y)-1) / (y))
+// Unlike ((x) + (y) - 1) / (y), does not wrap for sizes close to UINT64_MAX.
+#define DIV_ROUND_UP(x, y) ((x) / (y) + ((x) % (y) != 0))
 
-static void getprocname(pid_t pid, std::string* name) {
+// Count the C++ allocations of the process, including those made by
+// libmemtrack, while --bench runs.  Allocations made with malloc directly
+// are not counted, but show up in the heap usage reported next to them.
+static std::atomic<bool> counting_allocations{false};
+static std::atomic<uint64_t> allocations{0};
+
+static void* counted_alloc(size_t size, size_t align) {
+    if (counting_allocations.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* p = nullptr;
+    if (align <= alignof(std::max_align_t)) {
+        p = malloc(size ? size : 1);
+    } else if (posix_memalign(&p, align, size ? size : 1) != 0) {
+        p = nullptr;
+    }
+    if (p == nullptr) {
+        abort();
+    }
+    return p;
+}
+
+void* operator new(size_t size) {
+    return counted_alloc(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    return counted_alloc(size, static_cast<size_t>(align));
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    free(p);
+}
+
+// Bytes of heap in use, whether allocated with new or malloc.
+static size_t heap_bytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return mallinfo().uordblks;
+#endif
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static void getprocname(pid_t pid, std::string* name, FILE* err = stderr) {
     std::string fname = ::android::base::StringPrintf("/proc/%d/cmdline", pid);
     if (!::android::base::ReadFileToString(fname, name)) {
-        fprintf(stderr, "Failed to read cmdline from: %s\n", fname.c_str());
+        fprintf(err, "Failed to read cmdline from: %s\n", fname.c_str());
         *name = "<unknown>";
     }
 }
 
-int main(int /* argc */, char** /* argv */) {
-    int ret;
-    struct memtrack_proc* p;
-    std::vector<pid_t> pids;
+static void print_groups(const char* title, const struct memtrack_snapshot_group* groups,
+                         size_t count, struct memtrack_snapshot* s, bool cgroups) {
+    fprintf(stdout, "%s:\n", title);
+    for (size_t i = 0; i < count; i++) {
+        const struct memtrack_snapshot_group& g = groups[i];
+        fprintf(stdout, "%5u %6" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64
+                        " %6" PRIu64 " ",
+                g.nr_procs, DIV_ROUND_UP(g.graphics_total, 1024),
+                DIV_ROUND_UP(g.graphics_pss, 1024), DIV_ROUND_UP(g.gl_total, 1024),
+                DIV_ROUND_UP(g.gl_pss, 1024), DIV_ROUND_UP(g.other_total, 1024),
+                DIV_ROUND_UP(g.other_pss, 1024));
+        if (cgroups) {
+            fprintf(stdout, "%s\n", memtrack_snapshot_cgroup_path(s, g.id));
+        } else {
+            fprintf(stdout, "%" PRIu64 "\n", g.id);
+        }
+    }
+}
 
-    p = memtrack_proc_new();
-    if (p == nullptr) {
-        fprintf(stderr, "failed to create memtrack process handle\n");
+static int print_grouped(uint32_t grouping) {
+    struct memtrack_snapshot* s = memtrack_snapshot_new();
+    if (s == nullptr) {
+        fprintf(stderr, "failed to create memtrack snapshot\n");
         exit(EXIT_FAILURE);
     }
 
-    for (auto& de : std::filesystem::directory_iterator("/proc")) {
-        if (!std::filesystem::is_directory(de.status())) {
-            continue;
+    memtrack_snapshot_set_grouping(s, grouping);
+    int ret = memtrack_snapshot_take(s);
+    if (ret) {
+        fprintf(stderr, "failed to take memtrack snapshot: %s (%d)\n", strerror(-ret), ret);
+    } else {
+        if (grouping & MEMTRACK_SNAPSHOT_GROUP_UID) {
+            print_groups("uid", memtrack_snapshot_uids(s), memtrack_snapshot_uid_count(s), s,
+                         false);
         }
-
-        pid_t pid;
-        if (!::android::base::ParseInt(de.path().filename().string(), &pid)) {
-            continue;
+        if (grouping & MEMTRACK_SNAPSHOT_GROUP_CGROUP) {
+            print_groups("cgroup", memtrack_snapshot_cgroups(s), memtrack_snapshot_cgroup_count(s),
+                         s, true);
         }
-        pids.emplace_back(pid);
     }
 
-    for (auto& pid : pids) {
-        size_t v1;
-        size_t v2;
-        size_t v3;
-        size_t v4;
-        size_t v5;
-        size_t v6;
+    memtrack_snapshot_destroy(s);
+    return ret;
+}
+
+static void list_processes(std::vector<pid_t>* pids) {
+    ssize_t n = 0;
+    do {
+        pids->resize(n + 64);
+        n = memtrack_list_processes(pids->data(), pids->size(), MEMTRACK_LIST_SKIP_KTHREADS);
+        if (n < 0) {
+            fprintf(stderr, "failed to list processes: %s (%zd)\n", strerror(-n), n);
+            exit(EXIT_FAILURE);
+        }
+    } while (static_cast<size_t>(n) > pids->size());
+    pids->resize(n);
+}
+
+/* Per-process costs of print_processes, collected by --bench. */
+struct SweepStats {
+    std::vector<uint64_t> latencies;
+    uint64_t failed = 0;
+};
+
+static int print_processes(struct memtrack_proc* p, const std::vector<pid_t>& pids, bool replay,
+                           FILE* out = stdout, FILE* err = stderr, SweepStats* stats = nullptr) {
+    int ret = 0;
+    for (pid_t pid : pids) {
+        uint64_t start = stats ? now_ns() : 0;
+        uint64_t v1;
+        uint64_t v2;
+        uint64_t v3;
+        uint64_t v4;
+        uint64_t v5;
+        uint64_t v6;
         std::string cmdline;
 
-        getprocname(pid, &cmdline);
+        if (replay) {
+            // The recorded processes are not running here.
+            cmdline = "<replay>";
+        } else {
+            getprocname(pid, &cmdline, err);
+        }
 
         ret = memtrack_proc_get(p, pid);
         if (ret) {
-            fprintf(stderr, "failed to get memory info for pid %d: %s (%d)\n", pid, strerror(-ret),
+            fprintf(err, "failed to get memory info for pid %d: %s (%d)\n", pid, strerror(-ret),
                     ret);
+            if (stats) {
+                stats->failed++;
+                stats->latencies.push_back(now_ns() - start);
+            }
             continue;
         }
 
-        v1 = DIV_ROUND_UP(memtrack_proc_graphics_total(p), 1024);
-        v2 = DIV_ROUND_UP(memtrack_proc_graphics_pss(p), 1024);
-        v3 = DIV_ROUND_UP(memtrack_proc_gl_total(p), 1024);
-        v4 = DIV_ROUND_UP(memtrack_proc_gl_pss(p), 1024);
-        v5 = DIV_ROUND_UP(memtrack_proc_other_total(p), 1024);
-        v6 = DIV_ROUND_UP(memtrack_proc_other_pss(p), 1024);
+        // Sizes that saturate are shown as UINT64_MAX / 1024.
+        memtrack_proc_graphics_total_u64(p, &v1);
+        memtrack_proc_graphics_pss_u64(p, &v2);
+        memtrack_proc_gl_total_u64(p, &v3);
+        memtrack_proc_gl_pss_u64(p, &v4);
+        memtrack_proc_other_total_u64(p, &v5);
+        memtrack_proc_other_pss_u64(p, &v6);
+        v1 = DIV_ROUND_UP(v1, 1024);
+        v2 = DIV_ROUND_UP(v2, 1024);
+        v3 = DIV_ROUND_UP(v3, 1024);
+        v4 = DIV_ROUND_UP(v4, 1024);
+        v5 = DIV_ROUND_UP(v5, 1024);
+        v6 = DIV_ROUND_UP(v6, 1024);
 
         if (v1 | v2 | v3 | v4 | v5 | v6) {
-            fprintf(stdout, "%5d %6zu %6zu %6zu %6zu %6zu %6zu %s\n", pid, v1, v2, v3, v4, v5, v6,
-                    cmdline.c_str());
+            fprintf(out,
+                    "%5d %6" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64
+                    " %s\n",
+                    pid, v1, v2, v3, v4, v5, v6, cmdline.c_str());
+        }
+        if (stats) {
+            stats->latencies.push_back(now_ns() - start);
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * Run the default sweep sweeps times, listing the processes, reading their
+ * names, querying them and formatting the lines as usual, with the output
+ * sent to /dev/null, and report the cost of doing so.
+ */
+static int bench(struct memtrack_proc* p, std::vector<pid_t>* pids, bool replay,
+                 unsigned int sweeps) {
+    FILE* sink = fopen("/dev/null", "we");
+    if (sink == nullptr) {
+        int err = errno;
+        fprintf(stderr, "failed to open /dev/null: %s\n", strerror(err));
+        return -err;
+    }
+
+    SweepStats stats;
+    uint64_t calls = memtrack_backend_calls();
+    size_t heap = heap_bytes();
+    allocations.store(0, std::memory_order_relaxed);
+    counting_allocations.store(true, std::memory_order_relaxed);
+    uint64_t start = now_ns();
+    for (unsigned int i = 0; i < sweeps; i++) {
+        list_processes(pids);
+        print_processes(p, *pids, replay, sink, sink, &stats);
+        fflush(sink);
+    }
+    double secs = (now_ns() - start) / 1e9;
+    calls = memtrack_backend_calls() - calls;
+    counting_allocations.store(false, std::memory_order_relaxed);
+    uint64_t allocs = allocations.load(std::memory_order_relaxed);
+    ssize_t heap_growth = static_cast<ssize_t>(heap_bytes() - heap);
+    fclose(sink);
+
+    std::vector<uint64_t>& latencies = stats.latencies;
+    if (latencies.empty()) {
+        fprintf(stderr, "no processes to query\n");
+        return -ENOENT;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t p50 = latencies[latencies.size() / 2];
+    uint64_t p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    fprintf(stdout,
+            "sweeps:            %u of %zu processes in %.3f s (%" PRIu64 " failed queries)\n"
+            "sweeps/s:          %.1f\n"
+            "pids/s:            %.0f\n"
+            "backend calls/s:   %.0f\n"
+            "per pid p50/p99:   %.1f / %.1f us\n"
+            "C++ allocations:   %" PRIu64 " (%.2f per pid)\n"
+            "heap growth:       %zd bytes\n"
+            "peak rss:          %ld KiB\n",
+            sweeps, latencies.size() / sweeps, secs, stats.failed, sweeps / secs,
+            latencies.size() / secs, calls / secs, p50 / 1e3, p99 / 1e3, allocs,
+            static_cast<double>(allocs) / latencies.size(), heap_growth, ru.ru_maxrss);
+    return 0;
+}
+
+/*
+ * Print every process each time memory pressure is reported, reusing p and
+ * pids.  The window is 2s, the shortest allowed without CAP_SYS_RESOURCE.
+ */
+static int sample_on_pressure(struct memtrack_proc* p, std::vector<pid_t>* pids, bool replay,
+                              unsigned int stall_ms, unsigned int interval_ms) {
+    struct memtrack_psi_trigger* t = memtrack_psi_trigger_new(stall_ms, 2000, 0, interval_ms);
+    if (t == nullptr) {
+        int err = errno;
+        fprintf(stderr, "failed to arm memory pressure trigger: %s\n", strerror(err));
+        return -err;
+    }
+
+    int ret;
+    while ((ret = memtrack_psi_trigger_wait(t, -1)) > 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        fprintf(stdout, "memory pressure at %lld.%03ld\n", static_cast<long long>(ts.tv_sec),
+                ts.tv_nsec / 1000000);
+        list_processes(pids);
+        print_processes(p, *pids, replay);
+        fflush(stdout);
+    }
+    fprintf(stderr, "failed to wait for memory pressure: %s (%d)\n", strerror(-ret), ret);
+    memtrack_psi_trigger_destroy(t);
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    int ret;
+    struct memtrack_proc* p;
+    std::vector<pid_t> pids;
+    uint32_t grouping = 0;
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    uint32_t replay_flags = 0;
+    unsigned int bench_sweeps = 0;
+    unsigned int psi_stall_ms = 0;
+    unsigned int psi_interval_ms = 1000;
+
+    static const struct option long_options[] = {
+            {"bench", required_argument, nullptr, 'b'},
+            {"psi", required_argument, nullptr, 'P'},
+            {"psi-interval", required_argument, nullptr, 'I'},
+            {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "ucr:R:t", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'u':
+                grouping |= MEMTRACK_SNAPSHOT_GROUP_UID;
+                break;
+            case 'c':
+                grouping |= MEMTRACK_SNAPSHOT_GROUP_CGROUP;
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'R':
+                replay_path = optarg;
+                break;
+            case 't':
+                replay_flags |= MEMTRACK_REPLAY_TIMING;
+                break;
+            case 'b':
+                if (!::android::base::ParseUint(optarg, &bench_sweeps) || bench_sweeps == 0) {
+                    fprintf(stderr, "invalid number of sweeps: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'P':
+                if (!::android::base::ParseUint(optarg, &psi_stall_ms, 1999u) ||
+                    psi_stall_ms == 0) {
+                    fprintf(stderr, "invalid stall time: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'I':
+                if (!::android::base::ParseUint(optarg, &psi_interval_ms)) {
+                    fprintf(stderr, "invalid interval: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-u] [-c] [-r trace | -R trace [-t]] [--bench sweeps]\n"
+                                "          [--psi stall_ms [--psi-interval ms]]\n"
+                                "  -u       sum processes by uid\n"
+                                "  -c       sum processes by cgroup\n"
+                                "  -r       record the responses of the backend to trace\n"
+                                "  -R       query the responses recorded in trace instead\n"
+                                "  -t       with -R, take as long as the recorded queries did\n"
+                                "  --bench  run the sweep sweeps times, without output, and\n"
+                                "           report throughput, latency, allocations and peak\n"
+                                "           rss\n"
+                                "  --psi    print every process each time tasks stall on memory\n"
+                                "           for stall_ms within two seconds, instead of once\n"
+                                "  --psi-interval\n"
+                                "           print at most once per ms (default 1000)\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (replay_path) {
+        ret = memtrack_replay_load(replay_path, replay_flags);
+        if (ret) {
+            fprintf(stderr, "failed to load trace %s: %s (%d)\n", replay_path, strerror(-ret),
+                    ret);
+            exit(EXIT_FAILURE);
         }
     }
+    if (record_path) {
+        ret = memtrack_record_start(record_path);
+        if (ret) {
+            fprintf(stderr, "failed to record to %s: %s (%d)\n", record_path, strerror(-ret),
+                    ret);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (grouping) {
+        ret = print_grouped(grouping);
+        if (record_path) {
+            memtrack_record_stop();
+        }
+        return ret;
+    }
+
+    p = memtrack_proc_new();
+    if (p == nullptr) {
+        fprintf(stderr, "failed to create memtrack process handle\n");
+        exit(EXIT_FAILURE);
+    }
+
+    list_processes(&pids);
+
+    if (bench_sweeps) {
+        ret = bench(p, &pids, replay_path != nullptr, bench_sweeps);
+        memtrack_proc_destroy(p);
+        if (record_path) {
+            memtrack_record_stop();
+        }
+        return ret;
+    }
+
+    if (psi_stall_ms) {
+        ret = sample_on_pressure(p, &pids, replay_path != nullptr, psi_stall_ms, psi_interval_ms);
+    } else {
+        ret = print_processes(p, pids, replay_path != nullptr);
+    }
 
     memtrack_proc_destroy(p);
 
+    if (record_path) {
+        int err = memtrack_record_stop();
+        if (err) {
+            fprintf(stderr, "failed to write trace %s: %s (%d)\n", record_path, strerror(-err),
+                    err);
+            ret = err;
+        }
+    }
     return ret;
 }
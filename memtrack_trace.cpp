@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+#include "memtrack_trace_format.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+
+static_assert(kMemtrackTraceSmapsAccounted == static_cast<uint32_t>(MemtrackFlag::SMAPS_ACCOUNTED));
+static_assert(kMemtrackTraceSmapsUnaccounted ==
+              static_cast<uint32_t>(MemtrackFlag::SMAPS_UNACCOUNTED));
+static_assert(kMemtrackTraceShared == static_cast<uint32_t>(MemtrackFlag::SHARED));
+static_assert(kMemtrackTraceSharedPss == static_cast<uint32_t>(MemtrackFlag::SHARED_PSS));
+static_assert(kMemtrackTracePrivate == static_cast<uint32_t>(MemtrackFlag::PRIVATE));
+
+/* Bytes buffered by the recorder before they are written out. */
+static constexpr size_t kFlushSize = 64 * 1024;
+
+static int write_all(int fd, const std::string& buf) {
+    if (!::android::base::WriteFully(fd, buf.data(), buf.size())) {
+        return -errno;
+    }
+    return 0;
+}
+
+/* Recorder */
+
+static std::atomic<bool> recording{false};
+namespace {
+
+struct Recorder {
+    std::mutex lock;
+    ::android::base::unique_fd fd;
+    std::string buf;
+    int err = 0;
+};
+
+}  // namespace
+
+/* Intentionally leaked: detached library threads may still record at exit. */
+static Recorder* const recorder = new Recorder();
+
+bool memtrack_recording() {
+    return recording.load(std::memory_order_relaxed);
+}
+
+void memtrack_record(pid_t pid, MemtrackType type, int status,
+                     const std::vector<MemtrackRecord>& records, uint64_t latency_ns) {
+    std::lock_guard<std::mutex> lock(recorder->lock);
+    if (recorder->fd < 0) {
+        return;
+    }
+
+    size_t count = status == 0 ? records.size() : 0;
+    memtrack_trace_put_response(&recorder->buf, pid, static_cast<uint32_t>(type), status,
+                                latency_ns, count);
+    for (size_t i = 0; i < count; i++) {
+        memtrack_trace_put_record(&recorder->buf, records[i].sizeInBytes, records[i].flags);
+    }
+
+    if (recorder->buf.size() >= kFlushSize) {
+        int ret = write_all(recorder->fd, recorder->buf);
+        if (ret < 0 && recorder->err == 0) {
+            recorder->err = ret;
+        }
+        recorder->buf.clear();
+    }
+}
+
+int memtrack_record_start(const char* path) {
+    if (!path) {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(recorder->lock);
+    if (recorder->fd >= 0) {
+        return -EBUSY;
+    }
+
+    ::android::base::unique_fd fd(open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (fd < 0) {
+        return -errno;
+    }
+
+    memtrack_trace_put_header(&recorder->buf);
+    recorder->buf.reserve(kFlushSize + 4096);
+    recorder->err = 0;
+    recorder->fd = std::move(fd);
+    recording.store(true, std::memory_order_relaxed);
+    return 0;
+}
+
+int memtrack_record_stop(void) {
+    std::lock_guard<std::mutex> lock(recorder->lock);
+    if (recorder->fd < 0) {
+        return -EINVAL;
+    }
+
+    recording.store(false, std::memory_order_relaxed);
+    int ret = write_all(recorder->fd, recorder->buf);
+    if (recorder->err != 0) {
+        ret = recorder->err;
+    }
+    if (fsync(recorder->fd) < 0 && ret == 0) {
+        ret = -errno;
+    }
+    recorder->fd.reset();
+    recorder->buf.clear();
+    recorder->buf.shrink_to_fit();
+    return ret;
+}
+
+/* Replay */
+
+class ReplayBackend : public MemtrackBackend {
+  public:
+    int load(const std::string& trace, bool timing);
+    bool loaded() const { return loaded_.load(std::memory_order_acquire); }
+    void listPids(std::vector<pid_t>* pids);
+
+    int getMemory(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records) override;
+
+  private:
+    struct Response {
+        int status;
+        uint64_t latency_ns;
+        size_t first;
+        size_t count;
+    };
+
+    /* The responses recorded for one (pid, type), served in turn. */
+    struct Stream {
+        std::vector<uint32_t> responses;
+        size_t next;
+    };
+
+    static uint64_t key(pid_t pid, MemtrackType type) {
+        return static_cast<uint64_t>(pid) << 8 | static_cast<uint32_t>(type);
+    }
+
+    std::mutex lock_;
+    std::atomic<bool> loaded_{false};
+    bool timing_ = false;
+    std::vector<Response> responses_;
+    std::vector<MemtrackRecord> records_;
+    MemtrackFlatMap<Stream> streams_;
+    std::vector<pid_t> pids_;
+};
+
+int ReplayBackend::load(const std::string& trace, bool timing) {
+    uint32_t header[2];
+    if (trace.size() < sizeof(header)) {
+        return -EINVAL;
+    }
+    memcpy(header, trace.data(), sizeof(header));
+    if (header[0] != kMemtrackTraceMagic || header[1] != kMemtrackTraceVersion) {
+        return -EINVAL;
+    }
+
+    std::vector<Response> responses;
+    std::vector<MemtrackRecord> records;
+    MemtrackFlatMap<Stream> streams;
+    std::vector<pid_t> pids;
+    for (size_t pos = sizeof(header); pos < trace.size();) {
+        uint64_t pid, type, status, latency_ns, count;
+        if (!memtrack_trace_get_varint(trace, &pos, &pid) ||
+            !memtrack_trace_get_varint(trace, &pos, &type) ||
+            !memtrack_trace_get_varint(trace, &pos, &status) ||
+            !memtrack_trace_get_varint(trace, &pos, &latency_ns) ||
+            !memtrack_trace_get_varint(trace, &pos, &count) ||
+            type >= (uint64_t)MemtrackType::NUM_TYPES || count > trace.size() - pos) {
+            return -EINVAL;
+        }
+
+        Response r;
+        r.status = static_cast<int>((status >> 1) ^ -(status & 1));
+        r.latency_ns = latency_ns;
+        r.first = records.size();
+        r.count = count;
+        for (uint64_t i = 0; i < count; i++) {
+            MemtrackRecord rec;
+            uint64_t flags;
+            if (!memtrack_trace_get_varint(trace, &pos, &rec.sizeInBytes) ||
+                !memtrack_trace_get_varint(trace, &pos, &flags)) {
+                return -EINVAL;
+            }
+            rec.flags = static_cast<uint32_t>(flags);
+            records.push_back(rec);
+        }
+
+        auto [stream, inserted] =
+                streams.insert(key(static_cast<pid_t>(pid), static_cast<MemtrackType>(type)));
+        if (inserted) {
+            pids.push_back(static_cast<pid_t>(pid));
+        }
+        stream->responses.push_back(responses.size());
+        responses.push_back(r);
+    }
+    std::sort(pids.begin(), pids.end());
+    pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+
+    std::lock_guard<std::mutex> lock(lock_);
+    responses_ = std::move(responses);
+    records_ = std::move(records);
+    streams_ = std::move(streams);
+    pids_ = std::move(pids);
+    timing_ = timing;
+    loaded_.store(true, std::memory_order_release);
+    return 0;
+}
+
+void ReplayBackend::listPids(std::vector<pid_t>* pids) {
+    std::lock_guard<std::mutex> lock(lock_);
+    pids->insert(pids->end(), pids_.begin(), pids_.end());
+}
+
+int ReplayBackend::getMemory(pid_t pid, MemtrackType type, std::vector<MemtrackRecord>* records) {
+    uint64_t latency_ns;
+    int status;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        Stream* stream = streams_.find(key(pid, type));
+        if (!stream) {
+            records->clear();
+            return -ESRCH;
+        }
+
+        const Response& r = responses_[stream->responses[stream->next]];
+        stream->next = (stream->next + 1) % stream->responses.size();
+        records->assign(records_.begin() + r.first, records_.begin() + r.first + r.count);
+        latency_ns = timing_ ? r.latency_ns : 0;
+        status = r.status;
+    }
+
+    if (latency_ns) {
+        struct timespec ts;
+        ts.tv_sec = latency_ns / 1000000000;
+        ts.tv_nsec = latency_ns % 1000000000;
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+        }
+    }
+    return status;
+}
+
+/* Intentionally leaked, like the recorder. */
+static ReplayBackend* const replay = new ReplayBackend();
+
+MemtrackBackend* memtrack_replay_backend() {
+    return replay->loaded() ? replay : nullptr;
+}
+
+void memtrack_replay_list_pids(std::vector<pid_t>* pids) {
+    replay->listPids(pids);
+}
+
+int memtrack_replay_load(const char* path, uint32_t flags) {
+    if (!path || (flags & ~MEMTRACK_REPLAY_TIMING)) {
+        return -EINVAL;
+    }
+
+    std::string trace;
+    if (!::android::base::ReadFileToString(path, &trace)) {
+        return -errno;
+    }
+    int ret = replay->load(trace, flags & MEMTRACK_REPLAY_TIMING);
+    if (ret < 0) {
+        return ret;
+    }
+    return memtrack_set_backend(MEMTRACK_BACKEND_REPLAY);
+}
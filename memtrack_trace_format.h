@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBMEMTRACK_MEMTRACK_TRACE_FORMAT_H_
+#define _LIBMEMTRACK_MEMTRACK_TRACE_FORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+/*
+ * Format of the traces written by memtrack_record_start and read by
+ * memtrack_replay_load, shared with the tools that generate traces.  It does
+ * not depend on the HAL headers, so tools can use it without linking them.
+ *
+ * A trace is an 8 byte header (magic, version) followed by one record per
+ * backend response, in the order the responses were returned:
+ *   varint pid
+ *   varint type
+ *   zigzag varint status
+ *   varint latency_ns
+ *   varint count
+ *   count times:
+ *     varint sizeInBytes
+ *     varint flags
+ */
+static constexpr uint32_t kMemtrackTraceMagic = 0x524b544d;  // "MTKR"
+static constexpr uint32_t kMemtrackTraceVersion = 1;
+
+/* Values of MemtrackFlag in the memtrack HAL, checked in memtrack_trace.cpp. */
+static constexpr uint32_t kMemtrackTraceSmapsAccounted = 1 << 1;
+static constexpr uint32_t kMemtrackTraceSmapsUnaccounted = 1 << 2;
+static constexpr uint32_t kMemtrackTraceShared = 1 << 3;
+static constexpr uint32_t kMemtrackTraceSharedPss = 1 << 4;
+static constexpr uint32_t kMemtrackTracePrivate = 1 << 5;
+
+static inline void memtrack_trace_put_varint(std::string* out, uint64_t v) {
+    while (v >= 0x80) {
+        out->push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out->push_back(static_cast<char>(v));
+}
+
+static inline bool memtrack_trace_get_varint(const std::string& in, size_t* pos, uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *pos < in.size(); shift += 7) {
+        uint8_t b = static_cast<uint8_t>(in[(*pos)++]);
+        result |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Replace out with the header of an empty trace. */
+static inline void memtrack_trace_put_header(std::string* out) {
+    uint32_t header[2] = {kMemtrackTraceMagic, kMemtrackTraceVersion};
+    out->assign(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+/* Append a response, to be followed by count calls to memtrack_trace_put_record. */
+static inline void memtrack_trace_put_response(std::string* out, pid_t pid, uint32_t type,
+                                               int status, uint64_t latency_ns, size_t count) {
+    memtrack_trace_put_varint(out, pid);
+    memtrack_trace_put_varint(out, type);
+    memtrack_trace_put_varint(out, (static_cast<uint64_t>(status) << 1) ^ (status >> 31));
+    memtrack_trace_put_varint(out, latency_ns);
+    memtrack_trace_put_varint(out, count);
+}
+
+static inline void memtrack_trace_put_record(std::string* out, uint64_t size, uint32_t flags) {
+    memtrack_trace_put_varint(out, size);
+    memtrack_trace_put_varint(out, flags);
+}
+
+#endif
@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+/*
+ * Watches are sampled by one scheduler thread, started by the first watch
+ * and living until the process exits.  Each watch is due again after an
+ * interval between min_interval and max_interval that shrinks linearly as
+ * its size approaches the threshold, so a process far from its limit costs
+ * a query every max_interval and one about to cross it is sampled every
+ * min_interval.
+ *
+ * Due watches are kept in a two level timing wheel of kTickNs ticks, so
+ * scheduling and removing a watch is O(1) however many there are.  The
+ * first level has a slot per tick for the next kSlots0 ticks; the second a
+ * slot per kSlots0 ticks beyond that, cascaded into the first level when
+ * its turn comes.  Watches further out wait in the last second level slot
+ * and are cascaded again.  Occupancy bitmaps let the scheduler sleep until
+ * the next occupied slot instead of waking up every tick.
+ *
+ * Every watch due at a tick is sampled in one batch, with one query per
+ * process covering the types of all of its watches.
+ */
+static constexpr uint64_t kTickNs = 10 * 1000000ULL;
+static constexpr unsigned int kBits0 = 8;
+static constexpr unsigned int kBits1 = 6;
+static constexpr uint64_t kSlots0 = 1 << kBits0;
+static constexpr uint64_t kSlots1 = 1 << kBits1;
+
+struct memtrack_watch {
+    memtrack_proc_id id;
+    uint32_t type_mask;
+    uint64_t threshold;
+    memtrack_watch_callback cb;
+    void* cookie;
+    uint64_t due_tick;
+    bool above;
+    bool armed;
+    bool sampling;
+    bool removed;
+    /* The wheel slot holding the watch, or -1, and its links there. */
+    int slot;
+    memtrack_watch* prev;
+    memtrack_watch* next;
+};
+
+namespace {
+
+struct WatchScheduler {
+    std::mutex lock;
+    std::condition_variable cv;
+    uint64_t min_interval_ns = 100 * 1000000ULL;
+    uint64_t max_interval_ns = 5000 * 1000000ULL;
+    bool started = false;
+    std::thread::id thread_id;
+    /* The simulated clock set by memtrack_watch_set_clock(), or NULL. */
+    uint64_t* clock = nullptr;
+    /* The last tick processed. */
+    uint64_t tick = 0;
+    memtrack_watch* level0[kSlots0] = {};
+    memtrack_watch* level1[kSlots1] = {};
+    uint64_t occupied0[kSlots0 / 64] = {};
+    uint64_t occupied1 = 0;
+};
+
+}  // namespace
+
+/* Intentionally leaked: the detached scheduler may still use it at exit. */
+static WatchScheduler* const sched = new WatchScheduler();
+
+static uint64_t now_ns() {
+    return sched->clock ? *sched->clock : memtrack_now_ns();
+}
+
+static uint64_t now_tick() {
+    return now_ns() / kTickNs;
+}
+
+/* Slots are numbered across both levels, the second level after the first. */
+static memtrack_watch** slot_head(int slot) {
+    return slot < static_cast<int>(kSlots0) ? &sched->level0[slot] : &sched->level1[slot - kSlots0];
+}
+
+static void set_occupied(int slot, bool occupied) {
+    uint64_t* word = slot < static_cast<int>(kSlots0) ? &sched->occupied0[slot / 64]
+                                                      : &sched->occupied1;
+    uint64_t bit = 1ULL << (slot % 64);
+    *word = occupied ? *word | bit : *word & ~bit;
+}
+
+static void link(int slot, memtrack_watch* w) {
+    memtrack_watch** head = slot_head(slot);
+    w->prev = nullptr;
+    w->next = *head;
+    if (*head) {
+        (*head)->prev = w;
+    }
+    *head = w;
+    w->slot = slot;
+    set_occupied(slot, true);
+}
+
+static void schedule(memtrack_watch* w) {
+    // Anything already due runs at the next tick processed.
+    uint64_t tick = std::max(w->due_tick, sched->tick + 1);
+    uint64_t delta = tick - sched->tick;
+    if (delta < kSlots0) {
+        link(tick & (kSlots0 - 1), w);
+    } else {
+        // Watches beyond the second level wait in its last slot.
+        tick = std::min(tick, sched->tick + kSlots0 * kSlots1 - 1);
+        link(kSlots0 + ((tick >> kBits0) & (kSlots1 - 1)), w);
+    }
+}
+
+static void unschedule(memtrack_watch* w) {
+    if (w->slot < 0) {
+        return;
+    }
+    if (w->next) {
+        w->next->prev = w->prev;
+    }
+    if (w->prev) {
+        w->prev->next = w->next;
+    } else {
+        *slot_head(w->slot) = w->next;
+        if (!w->next) {
+            set_occupied(w->slot, false);
+        }
+    }
+    w->slot = -1;
+}
+
+/* Detach and return the list in a slot. */
+static memtrack_watch* take(int slot) {
+    memtrack_watch** head = slot_head(slot);
+    memtrack_watch* list = *head;
+    *head = nullptr;
+    set_occupied(slot, false);
+    for (memtrack_watch* w = list; w; w = w->next) {
+        w->slot = -1;
+    }
+    return list;
+}
+
+/* Advance to tick, appending every watch due by then to batch. */
+static void advance(uint64_t tick, std::vector<memtrack_watch*>* batch) {
+    while (sched->tick < tick) {
+        uint64_t t = ++sched->tick;
+        if ((t & (kSlots0 - 1)) == 0) {
+            memtrack_watch* list = take(kSlots0 + ((t >> kBits0) & (kSlots1 - 1)));
+            while (list) {
+                memtrack_watch* w = list;
+                list = list->next;
+                if (w->due_tick <= t) {
+                    // Due at this very tick, which is processed next.
+                    link(t & (kSlots0 - 1), w);
+                } else {
+                    schedule(w);
+                }
+            }
+        }
+
+        size_t i = t & (kSlots0 - 1);
+        if (sched->occupied0[i / 64] & (1ULL << (i % 64))) {
+            for (memtrack_watch* w = take(i); w; w = w->next) {
+                batch->push_back(w);
+            }
+        }
+    }
+}
+
+/* Return the next tick with work, or 0 if the wheel is empty. */
+static uint64_t next_tick() {
+    // The next cascade, which may move watches into the first level ahead of
+    // those already there.
+    uint64_t cascade = sched->occupied1 ? ((sched->tick >> kBits0) + 1) << kBits0 : 0;
+    for (uint64_t d = 1; d <= kSlots0; d++) {
+        uint64_t t = sched->tick + d;
+        size_t i = t & (kSlots0 - 1);
+        if (!(sched->occupied0[i / 64] >> (i % 64))) {
+            // Skip the rest of this word at once.
+            d += 63 - (i % 64);
+            continue;
+        }
+        if (sched->occupied0[i / 64] & (1ULL << (i % 64))) {
+            return cascade ? std::min(t, cascade) : t;
+        }
+    }
+    return cascade;
+}
+
+/* The sampling intervals, read under the lock for a batch sampled outside it. */
+struct WatchIntervals {
+    uint64_t min_ns;
+    uint64_t max_ns;
+};
+
+static uint64_t next_interval(const memtrack_watch* w, uint64_t size,
+                              const WatchIntervals& intervals) {
+    uint64_t distance = size > w->threshold ? size - w->threshold : w->threshold - size;
+    double ratio = w->threshold ? std::min(1.0, static_cast<double>(distance) / w->threshold) : 1.0;
+    return intervals.min_ns + static_cast<uint64_t>((intervals.max_ns - intervals.min_ns) * ratio);
+}
+
+/* Sample the watches of one process, which all share its identity. */
+static void sample_process(memtrack_watch* const* watches, size_t n, memtrack_proc* p,
+                           const WatchIntervals& intervals) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!watches[i]->removed) {
+            mask |= watches[i]->type_mask;
+        }
+    }
+    if (!mask) {
+        return;
+    }
+
+    const memtrack_proc_id& id = watches[0]->id;
+    int ret = memtrack_proc_get_types(p, id.pid, mask);
+    // The pid may have been recycled, or the process gone, during the query.
+    int alive = memtrack_proc_id_alive(&id);
+
+    uint64_t now = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        memtrack_watch* w = watches[i];
+        // A callback may have removed a later watch of the batch.
+        if (w->removed) {
+            continue;
+        }
+
+        uint64_t size = 0;
+        int err = ret ? ret : memtrack_proc_total_u64(p, w->type_mask, &size);
+        uint64_t interval = intervals.max_ns;
+        if (alive == 0) {
+            w->armed = false;
+            w->cb(w, MEMTRACK_WATCH_GONE, 0, w->cookie);
+        } else if (err == 0 || err == -EOVERFLOW) {
+            bool above = size >= w->threshold;
+            if (above != w->above) {
+                w->above = above;
+                w->cb(w, above ? MEMTRACK_WATCH_ABOVE : MEMTRACK_WATCH_BELOW, size, w->cookie);
+            }
+            interval = next_interval(w, size, intervals);
+        }
+        // Transient failures are retried at the slowest pace rather than
+        // reported.
+        w->due_tick = (now + interval) / kTickNs;
+    }
+}
+
+/* Sample a batch outside the lock.  Called with the lock held. */
+static void sample(std::unique_lock<std::mutex>& lock, std::vector<memtrack_watch*>* batch,
+                   memtrack_proc* p) {
+    for (memtrack_watch* w : *batch) {
+        w->sampling = true;
+    }
+    WatchIntervals intervals = {sched->min_interval_ns, sched->max_interval_ns};
+    lock.unlock();
+
+    std::sort(batch->begin(), batch->end(), [](const memtrack_watch* a, const memtrack_watch* b) {
+        return a->id.pid < b->id.pid ||
+               (a->id.pid == b->id.pid && a->id.start_time < b->id.start_time);
+    });
+    for (size_t i = 0; i < batch->size();) {
+        size_t j = i + 1;
+        while (j < batch->size() && (*batch)[j]->id.pid == (*batch)[i]->id.pid &&
+               (*batch)[j]->id.start_time == (*batch)[i]->id.start_time) {
+            j++;
+        }
+        sample_process(batch->data() + i, j - i, p, intervals);
+        i = j;
+    }
+
+    lock.lock();
+    for (memtrack_watch* w : *batch) {
+        w->sampling = false;
+        if (w->removed) {
+            delete w;
+        } else if (w->armed) {
+            schedule(w);
+        }
+    }
+    batch->clear();
+    sched->cv.notify_all();
+}
+
+/*
+ * Sample every watch due by now, allocating *p on first use.  Returns the
+ * next tick with work, or 0 if the wheel is empty.  Called with the lock
+ * held.
+ */
+static uint64_t run_due(std::unique_lock<std::mutex>& lock, std::vector<memtrack_watch*>* batch,
+                        memtrack_proc** p) {
+    for (;;) {
+        advance(now_tick(), batch);
+        if (batch->empty()) {
+            return next_tick();
+        }
+
+        if (!*p) {
+            *p = memtrack_proc_new();
+        }
+        if (*p) {
+            sample(lock, batch, *p);
+        } else {
+            // Out of memory: retry at the slowest pace.
+            for (memtrack_watch* w : *batch) {
+                w->due_tick = sched->tick + sched->max_interval_ns / kTickNs;
+                schedule(w);
+            }
+            batch->clear();
+        }
+    }
+}
+
+static void scheduler() {
+    memtrack_proc* p = memtrack_proc_new();
+    std::vector<memtrack_watch*> batch;
+    std::unique_lock<std::mutex> lock(sched->lock);
+    for (;;) {
+        uint64_t tick = run_due(lock, &batch, &p);
+        if (tick == 0) {
+            sched->cv.wait(lock);
+        } else {
+            uint64_t now = memtrack_now_ns();
+            uint64_t due = tick * kTickNs;
+            if (due > now) {
+                sched->cv.wait_for(lock, std::chrono::nanoseconds(due - now));
+            }
+        }
+    }
+}
+
+int memtrack_watch_set_intervals(unsigned int min_interval_ms, unsigned int max_interval_ms) {
+    if (min_interval_ms == 0 || min_interval_ms > max_interval_ms) {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(sched->lock);
+    sched->min_interval_ns = static_cast<uint64_t>(min_interval_ms) * 1000000ULL;
+    sched->max_interval_ns = static_cast<uint64_t>(max_interval_ms) * 1000000ULL;
+    return 0;
+}
+
+memtrack_watch* memtrack_watch_add(const memtrack_proc_id* id, uint32_t type_mask,
+                                   uint64_t threshold, memtrack_watch_callback cb, void* cookie) {
+    if (!id || !cb || !type_mask || (type_mask & ~MEMTRACK_TYPE_MASK_ALL)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    memtrack_watch* w = new (std::nothrow) memtrack_watch();
+    if (!w) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    w->id = *id;
+    w->type_mask = type_mask;
+    w->threshold = threshold;
+    w->cb = cb;
+    w->cookie = cookie;
+    w->above = false;
+    w->armed = true;
+    w->sampling = false;
+    w->removed = false;
+    w->slot = -1;
+
+    std::lock_guard<std::mutex> lock(sched->lock);
+    if (!sched->started && !sched->clock) {
+        sched->tick = now_tick();
+    }
+    w->due_tick = 0;
+    schedule(w);
+    if (!sched->started && !sched->clock) {
+        std::thread t(scheduler);
+        sched->thread_id = t.get_id();
+        t.detach();
+        sched->started = true;
+    }
+    sched->cv.notify_all();
+    return w;
+}
+
+int memtrack_watch_remove(memtrack_watch* w) {
+    if (!w) {
+        return -EINVAL;
+    }
+
+    std::unique_lock<std::mutex> lock(sched->lock);
+    if (w->removed) {
+        return -EINVAL;
+    }
+    unschedule(w);
+
+    if (w->sampling) {
+        if (std::this_thread::get_id() == sched->thread_id) {
+            // Removed from a callback of its batch: freed once the batch is
+            // done.
+            w->removed = true;
+            return 0;
+        }
+        sched->cv.wait(lock, [w] { return !w->sampling; });
+    }
+    delete w;
+    return 0;
+}
+
+int memtrack_watch_set_clock(uint64_t* clock) {
+    std::lock_guard<std::mutex> lock(sched->lock);
+    if (sched->started) {
+        return -EBUSY;
+    }
+    sched->clock = clock;
+    if (clock) {
+        sched->tick = now_tick();
+    }
+    return 0;
+}
+
+void memtrack_watch_run_until(uint64_t time_ns) {
+    std::unique_lock<std::mutex> lock(sched->lock);
+    if (!sched->clock) {
+        return;
+    }
+    // Callbacks run on this thread, and may remove their watch.
+    sched->thread_id = std::this_thread::get_id();
+
+    memtrack_proc* p = nullptr;
+    std::vector<memtrack_watch*> batch;
+    for (;;) {
+        uint64_t tick = run_due(lock, &batch, &p);
+        if (*sched->clock >= time_ns) {
+            break;
+        }
+        // Jump to where the scheduler thread would wake up next.
+        *sched->clock = tick ? std::min(tick * kTickNs, time_ns) : time_ns;
+    }
+    memtrack_proc_destroy(p);
+}
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * memtrack_workload generates synthetic workloads as replay traces (see
+ * memtrack_record_start), so that libmemtrack and its tools can be measured
+ * with more processes or records than any real device has.  Given -n, it
+ * then replays the trace and reports the throughput of memtrack_test style
+ * sweeps over it.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <memtrack/memtrack.h>
+
+#include "memtrack_trace_format.h"
+
+enum class Dist { kFixed, kUniform, kExp };
+
+struct Config {
+    unsigned int pids = 500;
+    unsigned int idle_percent = 80;
+    unsigned int records = 4;
+    Dist records_dist = Dist::kUniform;
+    unsigned int mix[3] = {2, 1, 1};
+    unsigned int latency_us = 0;
+    Dist latency_dist = Dist::kExp;
+    unsigned int fail_permille = 0;
+    uint64_t seed = 1;
+};
+
+static void usage(const char* cmd) {
+    fprintf(stderr,
+            "usage: %s -o trace [-p pids] [-i idle_percent] [-r records] [-R dist]\n"
+            "          [-m private:shared:shared_pss] [-l latency_us] [-L dist]\n"
+            "          [-e fail_permille] [-s seed] [-n sweeps [-t]]\n"
+            "  -o  write the workload to trace\n"
+            "  -p  number of processes (default 500)\n"
+            "  -i  percentage of processes without memory (default 80)\n"
+            "  -r  mean records per memory type of the other processes (default 4)\n"
+            "  -R  distribution of record counts: fixed, uniform or exp (default uniform)\n"
+            "  -m  relative weights of private, shared and shared pss records (default 2:1:1)\n"
+            "  -l  mean query latency in microseconds (default 0)\n"
+            "  -L  distribution of latencies: fixed, uniform or exp (default exp)\n"
+            "  -e  queries that fail, per thousand (default 0)\n"
+            "  -s  random seed (default 1)\n"
+            "  -n  then replay the trace sweeps times and report the throughput\n"
+            "  -t  with -n, take as long as the generated latencies\n",
+            cmd);
+}
+
+static bool parse_dist(const char* s, Dist* dist) {
+    if (!strcmp(s, "fixed")) {
+        *dist = Dist::kFixed;
+    } else if (!strcmp(s, "uniform")) {
+        *dist = Dist::kUniform;
+    } else if (!strcmp(s, "exp")) {
+        *dist = Dist::kExp;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_mix(const char* s, unsigned int mix[3]) {
+    return sscanf(s, "%u:%u:%u", &mix[0], &mix[1], &mix[2]) == 3 && mix[0] + mix[1] + mix[2] > 0;
+}
+
+/* Draw a value with the given mean from dist. */
+static uint64_t draw(std::mt19937_64& rng, Dist dist, unsigned int mean) {
+    if (mean == 0) {
+        return 0;
+    }
+    switch (dist) {
+        case Dist::kFixed:
+            return mean;
+        case Dist::kUniform:
+            return std::uniform_int_distribution<uint64_t>(0, 2 * uint64_t(mean))(rng);
+        case Dist::kExp:
+            return std::exponential_distribution<double>(1.0 / mean)(rng);
+    }
+    return mean;
+}
+
+static void generate(const Config& c, std::string* trace, size_t* nr_records) {
+    std::mt19937_64 rng(c.seed);
+    std::uniform_int_distribution<unsigned int> percent(0, 99);
+    std::uniform_int_distribution<unsigned int> permille(0, 999);
+    std::uniform_int_distribution<unsigned int> kind(0, c.mix[0] + c.mix[1] + c.mix[2] - 1);
+    // Page multiples up to 64MiB, skewed towards small buffers.
+    std::geometric_distribution<uint64_t> pages(1.0 / 256);
+
+    memtrack_trace_put_header(trace);
+    *nr_records = 0;
+
+    pid_t pid = 1;
+    for (unsigned int i = 0; i < c.pids; i++) {
+        pid += 1 + rng() % 4;
+        bool idle = percent(rng) < c.idle_percent;
+        for (int type = 0; type < MEMTRACK_NUM_TYPES; type++) {
+            bool fail = permille(rng) < c.fail_permille;
+            size_t count = idle || fail ? 0 : draw(rng, c.records_dist, c.records);
+
+            memtrack_trace_put_response(trace, pid, type, fail ? -1 : 0,
+                                        draw(rng, c.latency_dist, c.latency_us) * 1000, count);
+            for (size_t j = 0; j < count; j++) {
+                unsigned int k = kind(rng);
+                uint32_t flags = percent(rng) < 50 ? kMemtrackTraceSmapsAccounted
+                                                   : kMemtrackTraceSmapsUnaccounted;
+                if (k < c.mix[0]) {
+                    flags |= kMemtrackTracePrivate;
+                } else if (k < c.mix[0] + c.mix[1]) {
+                    flags |= kMemtrackTraceShared;
+                } else {
+                    flags |= kMemtrackTraceSharedPss;
+                }
+                memtrack_trace_put_record(trace, std::min<uint64_t>(pages(rng) + 1, 16384) * 4096,
+                                          flags);
+            }
+            *nr_records += count;
+        }
+    }
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Replay the trace sweeps times over every process, as memtrack_test does. */
+static int run_sweeps(const char* path, unsigned int sweeps, uint32_t replay_flags) {
+    int ret = memtrack_replay_load(path, replay_flags);
+    if (ret) {
+        fprintf(stderr, "failed to load trace %s: %s (%d)\n", path, strerror(-ret), ret);
+        return ret;
+    }
+
+    std::vector<pid_t> pids;
+    ssize_t n = 0;
+    do {
+        pids.resize(n + 64);
+        n = memtrack_list_processes(pids.data(), pids.size(), 0);
+        if (n < 0) {
+            fprintf(stderr, "failed to list processes: %s (%zd)\n", strerror(-n), n);
+            return n;
+        }
+    } while (static_cast<size_t>(n) > pids.size());
+    pids.resize(n);
+
+    struct memtrack_proc* p = memtrack_proc_new();
+    if (p == nullptr) {
+        fprintf(stderr, "failed to create memtrack process handle\n");
+        return -ENOMEM;
+    }
+
+    uint64_t failed = 0;
+    uint64_t start = now_ns();
+    for (unsigned int i = 0; i < sweeps; i++) {
+        for (pid_t pid : pids) {
+            if (memtrack_proc_get(p, pid)) {
+                failed++;
+                continue;
+            }
+            memtrack_proc_graphics_total(p);
+            memtrack_proc_gl_total(p);
+            memtrack_proc_other_total(p);
+        }
+    }
+    double secs = (now_ns() - start) / 1e9;
+    memtrack_proc_destroy(p);
+
+    uint64_t queries = uint64_t(sweeps) * pids.size();
+    fprintf(stdout,
+            "%u sweeps of %zu processes in %.3f s: %.0f sweeps/s, %.0f pids/s, %.2f us/pid, "
+            "%" PRIu64 " failed\n",
+            sweeps, pids.size(), secs, sweeps / secs, queries / secs, secs * 1e6 / queries,
+            failed);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Config c;
+    const char* path = nullptr;
+    unsigned int sweeps = 0;
+    uint32_t replay_flags = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:p:i:r:R:m:l:L:e:s:n:t")) != -1) {
+        bool ok = true;
+        switch (opt) {
+            case 'o':
+                path = optarg;
+                break;
+            case 'p':
+                ok = ::android::base::ParseUint(optarg, &c.pids);
+                break;
+            case 'i':
+                ok = ::android::base::ParseUint(optarg, &c.idle_percent, 100u);
+                break;
+            case 'r':
+                ok = ::android::base::ParseUint(optarg, &c.records);
+                break;
+            case 'R':
+                ok = parse_dist(optarg, &c.records_dist);
+                break;
+            case 'm':
+                ok = parse_mix(optarg, c.mix);
+                break;
+            case 'l':
+                ok = ::android::base::ParseUint(optarg, &c.latency_us);
+                break;
+            case 'L':
+                ok = parse_dist(optarg, &c.latency_dist);
+                break;
+            case 'e':
+                ok = ::android::base::ParseUint(optarg, &c.fail_permille, 1000u);
+                break;
+            case 's':
+                ok = ::android::base::ParseUint(optarg, &c.seed);
+                break;
+            case 'n':
+                ok = ::android::base::ParseUint(optarg, &sweeps);
+                break;
+            case 't':
+                replay_flags |= MEMTRACK_REPLAY_TIMING;
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string trace;
+    size_t nr_records;
+    generate(c, &trace, &nr_records);
+    if (!::android::base::WriteStringToFile(trace, path)) {
+        fprintf(stderr, "failed to write %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    fprintf(stdout, "%u processes, %zu records, %zu bytes written to %s\n", c.pids, nr_records,
+            trace.size(), path);
+
+    if (sweeps && run_sweeps(path, sweeps, replay_flags)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
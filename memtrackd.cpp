@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * memtrackd samples the memory stats of every process once per interval and
+ * publishes the latest snapshot to a shared memory region, so that any number
+ * of readers can use memtrack_shm_read instead of calling into the HAL.
+ * Optionally every snapshot is also appended to a ring file for post-mortem
+ * analysis.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android-base/parseint.h>
+#include <memtrack/memtrack.h>
+
+static void usage(const char* cmd) {
+    fprintf(stderr,
+            "usage: %s [-i interval_ms] [-n max_processes] [-p path] [-H history_path]\n"
+            "          [-S history_bytes] [-z probe_every] [-Z full_every]\n"
+            "  -i  sampling interval in milliseconds (default 1000)\n"
+            "  -n  maximum number of processes per snapshot (default 4096)\n"
+            "  -p  path of the shared memory region (default %s)\n"
+            "  -H  also append every snapshot to the ring file at history_path\n"
+            "  -S  size of the ring file records in bytes (default 4194304)\n"
+            "  -z  query processes without memory only every probe_every samples\n"
+            "  -Z  with -z, query every process every full_every samples (default 60)\n",
+            cmd, MEMTRACK_SHM_DEFAULT_PATH);
+}
+
+int main(int argc, char** argv) {
+    unsigned int interval_ms = 1000;
+    size_t max_entries = 4096;
+    const char* path = MEMTRACK_SHM_DEFAULT_PATH;
+    const char* history_path = nullptr;
+    size_t history_size = 4 * 1024 * 1024;
+    unsigned int probe_every = 0;
+    unsigned int full_every = 60;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:p:H:S:z:Z:")) != -1) {
+        switch (opt) {
+            case 'i':
+                if (!::android::base::ParseUint(optarg, &interval_ms) || interval_ms == 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n':
+                if (!::android::base::ParseUint(optarg, &max_entries) || max_entries == 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p':
+                path = optarg;
+                break;
+            case 'H':
+                history_path = optarg;
+                break;
+            case 'S':
+                if (!::android::base::ParseUint(optarg, &history_size) || history_size == 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'z':
+                if (!::android::base::ParseUint(optarg, &probe_every)) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'Z':
+                if (!::android::base::ParseUint(optarg, &full_every)) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    struct memtrack_snapshot* s = memtrack_snapshot_new();
+    if (s == nullptr) {
+        fprintf(stderr, "failed to create memtrack snapshot\n");
+        return EXIT_FAILURE;
+    }
+    memtrack_snapshot_set_zero_skip(s, probe_every, full_every);
+
+    struct memtrack_shm_writer* w = memtrack_shm_writer_create(path, max_entries);
+    if (w == nullptr) {
+        fprintf(stderr, "failed to create %s: %s\n", path, strerror(errno));
+        memtrack_snapshot_destroy(s);
+        return EXIT_FAILURE;
+    }
+
+    struct memtrack_history* h = nullptr;
+    if (history_path != nullptr) {
+        h = memtrack_history_open(history_path, history_size);
+        if (h == nullptr) {
+            fprintf(stderr, "failed to open %s: %s\n", history_path, strerror(errno));
+            memtrack_shm_writer_destroy(w);
+            memtrack_snapshot_destroy(s);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (;;) {
+        int ret = memtrack_snapshot_take(s);
+        if (ret) {
+            fprintf(stderr, "failed to take snapshot: %s (%d)\n", strerror(-ret), ret);
+        } else {
+            memtrack_shm_publish(w, s);
+            if (h != nullptr) {
+                memtrack_history_append(h, s);
+            }
+        }
+
+        // Sample on a fixed cadence rather than a fixed gap between sweeps.
+        next.tv_sec += interval_ms / 1000;
+        next.tv_nsec += (interval_ms % 1000) * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+#include "memtrack_trace_format.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+/*
+ * Replays a trace in which every process reports 4KiB of graphics memory
+ * and gl_records records of 8KiB of GL memory.  The processes are real, so
+ * that they have start times to key the cache with.
+ */
+class CacheTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        p_ = memtrack_proc_new();
+        ASSERT_NE(nullptr, p_);
+    }
+
+    void TearDown() override {
+        memtrack_proc_destroy(p_);
+        memtrack_cache_configure(0, 0);
+        memtrack_set_backend(MEMTRACK_BACKEND_AUTO);
+        for (pid_t pid : children_) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    void load(const std::vector<pid_t>& pids, size_t gl_records = 1) {
+        std::string trace;
+        memtrack_trace_put_header(&trace);
+        for (pid_t pid : pids) {
+            for (uint32_t type = 0; type < MEMTRACK_NUM_TYPES; type++) {
+                size_t count = type == MEMTRACK_TYPE_GRAPHICS ? 1
+                               : type == MEMTRACK_TYPE_GL     ? gl_records
+                                                              : 0;
+                memtrack_trace_put_response(&trace, pid, type, 0, 0, count);
+                for (size_t i = 0; i < count; i++) {
+                    memtrack_trace_put_record(&trace, type == MEMTRACK_TYPE_GL ? 8192 : 4096,
+                                              kMemtrackTraceSmapsUnaccounted);
+                }
+            }
+        }
+        ASSERT_TRUE(::android::base::WriteStringToFile(trace, trace_.path));
+        ASSERT_EQ(0, memtrack_replay_load(trace_.path, 0));
+    }
+
+    /* Fork n processes that wait to be killed. */
+    std::vector<pid_t> spawn(size_t n) {
+        std::vector<pid_t> pids;
+        for (size_t i = 0; i < n; i++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                for (;;) {
+                    pause();
+                }
+            }
+            EXPECT_GT(pid, 0);
+            if (pid > 0) {
+                children_.push_back(pid);
+                pids.push_back(pid);
+            }
+        }
+        return pids;
+    }
+
+    memtrack_cache_stats stats() {
+        memtrack_cache_stats s;
+        memtrack_cache_get_stats(&s);
+        return s;
+    }
+
+    TemporaryFile trace_;
+    memtrack_proc* p_ = nullptr;
+    std::vector<pid_t> children_;
+};
+
+TEST_F(CacheTest, MissThenHit) {
+    load({getpid()});
+    ASSERT_EQ(0, memtrack_cache_configure(60000, 16));
+
+    uint64_t calls = memtrack_backend_calls();
+    ASSERT_EQ(0, memtrack_proc_get(p_, getpid()));
+    EXPECT_EQ(calls + MEMTRACK_NUM_TYPES, memtrack_backend_calls());
+    EXPECT_EQ(0u, stats().hits);
+    EXPECT_EQ(1u, stats().misses);
+
+    calls = memtrack_backend_calls();
+    ASSERT_EQ(0, memtrack_proc_get(p_, getpid()));
+    EXPECT_EQ(calls, memtrack_backend_calls());
+    EXPECT_EQ(1u, stats().hits);
+    EXPECT_EQ(4096, memtrack_proc_graphics_total(p_));
+    EXPECT_EQ(8192, memtrack_proc_gl_total(p_));
+}
+
+TEST_F(CacheTest, Expires) {
+    load({getpid()});
+    ASSERT_EQ(0, memtrack_cache_configure(50, 16));
+    ASSERT_EQ(0, memtrack_proc_get(p_, getpid()));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint64_t calls = memtrack_backend_calls();
+    ASSERT_EQ(0, memtrack_proc_get(p_, getpid()));
+    EXPECT_EQ(calls + MEMTRACK_NUM_TYPES, memtrack_backend_calls());
+    EXPECT_EQ(0u, stats().hits);
+    EXPECT_EQ(2u, stats().misses);
+}
+
+TEST_F(CacheTest, EvictsBeyondCapacity) {
+    // A max_entries of 1 is rounded up to 8 slots.
+    std::vector<pid_t> pids = spawn(9);
+    ASSERT_EQ(9u, pids.size());
+    load(pids);
+    ASSERT_EQ(0, memtrack_cache_configure(60000, 1));
+
+    for (size_t i = 0; i < 8; i++) {
+        ASSERT_EQ(0, memtrack_proc_get(p_, pids[i]));
+    }
+    EXPECT_EQ(0u, stats().evictions);
+    ASSERT_EQ(0, memtrack_proc_get(p_, pids[8]));
+    EXPECT_EQ(1u, stats().evictions);
+
+    // The newest process stays cached.
+    uint64_t calls = memtrack_backend_calls();
+    ASSERT_EQ(0, memtrack_proc_get(p_, pids[8]));
+    EXPECT_EQ(calls, memtrack_backend_calls());
+}
+
+TEST_F(CacheTest, TooManyRecordsNotCached) {
+    load({getpid()}, 9);
+    ASSERT_EQ(0, memtrack_cache_configure(60000, 16));
+    ASSERT_EQ(0, memtrack_proc_get(p_, getpid()));
+    EXPECT_EQ(9 * 8192, memtrack_proc_gl_total(p_));
+
+    uint64_t calls = memtrack_backend_calls();
+    ASSERT_EQ(0, memtrack_proc_get(p_, getpid()));
+    EXPECT_EQ(calls + MEMTRACK_NUM_TYPES, memtrack_backend_calls());
+    EXPECT_EQ(0u, stats().hits);
+}
+
+TEST_F(CacheTest, HitOnlyReportsRequestedTypes) {
+    load({getpid()});
+    ASSERT_EQ(0, memtrack_cache_configure(60000, 16));
+    ASSERT_EQ(0, memtrack_proc_get(p_, getpid()));
+
+    uint64_t calls = memtrack_backend_calls();
+    uint32_t gl = MEMTRACK_TYPE_MASK(MEMTRACK_TYPE_GL);
+    ASSERT_EQ(0, memtrack_proc_get_types(p_, getpid(), gl));
+    EXPECT_EQ(calls, memtrack_backend_calls());
+    EXPECT_EQ(gl, memtrack_proc_valid_types(p_));
+    EXPECT_EQ(8192, memtrack_proc_gl_total(p_));
+    EXPECT_EQ(-ENODATA, memtrack_proc_graphics_total(p_));
+    EXPECT_EQ(-ENODATA, memtrack_proc_type_status(p_, MEMTRACK_TYPE_GRAPHICS));
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+#include "memtrack_trace_format.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+/*
+ * A follower that joins a failed call must not return the leader's error.
+ * The replayed OTHER query of the test process first fails after a delay,
+ * long enough for a second query to join it, and then succeeds.
+ */
+TEST(CoalesceTest, FollowerRetriesFailedLeader) {
+    std::string trace;
+    memtrack_trace_put_header(&trace);
+    memtrack_trace_put_response(&trace, getpid(), MEMTRACK_TYPE_OTHER, -EIO, 300000000, 0);
+    memtrack_trace_put_response(&trace, getpid(), MEMTRACK_TYPE_OTHER, 0, 0, 1);
+    memtrack_trace_put_record(&trace, 4096,
+                              kMemtrackTraceSmapsUnaccounted | kMemtrackTracePrivate);
+    for (uint32_t type = MEMTRACK_TYPE_OTHER + 1; type < MEMTRACK_NUM_TYPES; type++) {
+        memtrack_trace_put_response(&trace, getpid(), type, 0, 0, 0);
+    }
+    TemporaryFile file;
+    ASSERT_TRUE(::android::base::WriteStringToFile(trace, file.path));
+    ASSERT_EQ(0, memtrack_replay_load(file.path, MEMTRACK_REPLAY_TIMING));
+    ASSERT_EQ(0, memtrack_set_coalescing(1));
+
+    int leader_ret = 0;
+    std::thread leader([&leader_ret] {
+        memtrack_proc* p = memtrack_proc_new();
+        leader_ret = memtrack_proc_get(p, getpid());
+        memtrack_proc_destroy(p);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    memtrack_proc* p = memtrack_proc_new();
+    EXPECT_EQ(0, memtrack_proc_get(p, getpid()));
+    EXPECT_EQ(4096, memtrack_proc_other_total(p));
+    memtrack_proc_destroy(p);
+
+    leader.join();
+    EXPECT_EQ(-EIO, leader_ret);
+    memtrack_set_backend(MEMTRACK_BACKEND_AUTO);
+}
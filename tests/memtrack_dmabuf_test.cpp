@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+using ::android::base::StringPrintf;
+
+/* A fake /proc holding only the files the dma-buf backend reads. */
+class DmabufBackendTest : public ::testing::Test {
+  protected:
+    void addFd(pid_t pid, int fd, uint64_t inode, uint64_t size) {
+        std::string dir = makePidDir(pid) + "/fdinfo";
+        std::string fdinfo = StringPrintf(
+                "pos:\t0\nflags:\t02\nmnt_id:\t9\nino:\t%" PRIu64 "\nsize:\t%" PRIu64
+                "\ncount:\t1\nexp_name:\tsystem\n",
+                inode, size);
+        ASSERT_TRUE(::android::base::WriteStringToFile(fdinfo,
+                                                       StringPrintf("%s/%d", dir.c_str(), fd)));
+    }
+
+    void addMap(pid_t pid, uint64_t inode, uint64_t size) {
+        makePidDir(pid);
+        std::string& maps = maps_[pid];
+        uint64_t start = 0x7f0000000000ULL + maps.size() * 0x100000;
+        maps += StringPrintf("%" PRIx64 "-%" PRIx64 " rw-s 00000000 00:0e %" PRIu64
+                             "                    /dmabuf:\n",
+                             start, start + size, inode);
+        ASSERT_TRUE(::android::base::WriteStringToFile(
+                maps, StringPrintf("%s/%d/maps", root_.path, pid)));
+    }
+
+    /* Sum the records of pid by whether they count towards total and pss. */
+    int query(pid_t pid, uint64_t* total, uint64_t* pss) {
+        if (!backend_) {
+            backend_ = memtrack_create_dmabuf_backend(root_.path);
+        }
+        std::vector<MemtrackRecord> records;
+        int ret = backend_->getMemory(pid, MemtrackType::GRAPHICS, &records);
+        *total = 0;
+        *pss = 0;
+        for (const auto& r : records) {
+            *total += r.sizeInBytes;
+            if (r.flags & static_cast<uint32_t>(MemtrackFlag::SMAPS_UNACCOUNTED)) {
+                *pss += r.sizeInBytes;
+            }
+        }
+        return ret;
+    }
+
+  private:
+    std::string makePidDir(pid_t pid) {
+        std::string dir = StringPrintf("%s/%d", root_.path, pid);
+        mkdir(dir.c_str(), 0755);
+        if (maps_.find(pid) == maps_.end()) {
+            // Every process has an fdinfo directory and a maps file, if only
+            // empty ones.
+            maps_[pid];
+            mkdir((dir + "/fdinfo").c_str(), 0755);
+            ::android::base::WriteStringToFile("", dir + "/maps");
+        }
+        return dir;
+    }
+
+    TemporaryDir root_;
+    std::map<pid_t, std::string> maps_;
+    std::unique_ptr<MemtrackBackend> backend_;
+};
+
+TEST_F(DmabufBackendTest, FdinfoOnly) {
+    addFd(100, 5, 1000, 4096);
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ(4096u, total);
+    EXPECT_EQ(4096u, pss);
+}
+
+TEST_F(DmabufBackendTest, MapsOnly) {
+    addMap(100, 1000, 8192);
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ(8192u, total);
+    EXPECT_EQ(8192u, pss);
+}
+
+TEST_F(DmabufBackendTest, FdAndMapCountedOnce) {
+    // Two fds to the same buffer, which is also partially mapped.
+    addFd(100, 5, 1000, 16384);
+    addFd(100, 6, 1000, 16384);
+    addMap(100, 1000, 4096);
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ(16384u, total);
+    EXPECT_EQ(16384u, pss);
+}
+
+TEST_F(DmabufBackendTest, PssSplitAcrossSharers) {
+    addFd(100, 5, 1000, 12288);
+    addMap(101, 1000, 12288);
+    addFd(102, 5, 1000, 12288);
+    addFd(102, 6, 2000, 4096);
+
+    uint64_t total, pss;
+    for (pid_t pid : {100, 101}) {
+        ASSERT_EQ(0, query(pid, &total, &pss));
+        EXPECT_EQ(12288u, total);
+        EXPECT_EQ(4096u, pss);
+    }
+    ASSERT_EQ(0, query(102, &total, &pss));
+    EXPECT_EQ(12288u + 4096u, total);
+    EXPECT_EQ(4096u + 4096u, pss);
+}
+
+TEST_F(DmabufBackendTest, MissingPid) {
+    addFd(100, 5, 1000, 4096);
+
+    uint64_t total, pss;
+    EXPECT_EQ(-ENOENT, query(200, &total, &pss));
+    EXPECT_EQ(0u, total);
+}
+
+TEST_F(DmabufBackendTest, OtherTypesEmpty) {
+    addFd(100, 5, 1000, 4096);
+
+    std::unique_ptr<MemtrackBackend> backend = memtrack_create_dmabuf_backend("/nonexistent");
+    std::vector<MemtrackRecord> records = {{1, 0}};
+    EXPECT_EQ(0, backend->getMemory(100, MemtrackType::GL, &records));
+    EXPECT_TRUE(records.empty());
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+using ::android::base::StringPrintf;
+
+/* A fake /proc holding only the fdinfo files the DRM backend reads. */
+class DrmBackendTest : public ::testing::Test {
+  protected:
+    void addFd(pid_t pid, int fd, const std::string& drm_keys) {
+        std::string dir = StringPrintf("%s/%d", root_.path, pid);
+        mkdir(dir.c_str(), 0755);
+        mkdir((dir + "/fdinfo").c_str(), 0755);
+        std::string fdinfo = "pos:\t0\nflags:\t02100002\nmnt_id:\t24\nino:\t512\n" + drm_keys;
+        ASSERT_TRUE(::android::base::WriteStringToFile(
+                fdinfo, StringPrintf("%s/fdinfo/%d", dir.c_str(), fd)));
+    }
+
+    /* The fdinfo keys of client id of the GPU at pdev, followed by sizes. */
+    static std::string client(const char* pdev, int id, const std::string& sizes) {
+        return StringPrintf("drm-driver:\tmsm\ndrm-pdev:\t%s\ndrm-client-id:\t%d\n", pdev, id) +
+               sizes;
+    }
+
+    /* Sum the records of pid by whether they count towards total and pss. */
+    int query(pid_t pid, uint64_t* total, uint64_t* pss) {
+        if (!backend_) {
+            backend_ = memtrack_create_drm_backend(root_.path);
+        }
+        std::vector<MemtrackRecord> records;
+        int ret = backend_->getMemory(pid, MemtrackType::GL, &records);
+        *total = 0;
+        *pss = 0;
+        for (const auto& r : records) {
+            *total += r.sizeInBytes;
+            if (r.flags & static_cast<uint32_t>(MemtrackFlag::SMAPS_UNACCOUNTED)) {
+                *pss += r.sizeInBytes;
+            }
+        }
+        return ret;
+    }
+
+  private:
+    TemporaryDir root_;
+    std::unique_ptr<MemtrackBackend> backend_;
+};
+
+TEST_F(DrmBackendTest, TotalPreferredOverMemory) {
+    // Drivers that print drm-total-* may keep printing the legacy keys.
+    addFd(100, 5, client("0000:00:02.0", 1,
+                         "drm-total-system:\t8192\ndrm-memory-system:\t4096\n"
+                         "drm-total-vram:\t4096\ndrm-memory-vram:\t4096\n"));
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ(12288u, total);
+    EXPECT_EQ(12288u, pss);
+}
+
+TEST_F(DrmBackendTest, LegacyMemoryKeys) {
+    addFd(100, 5, client("0000:00:02.0", 1,
+                         "drm-memory-system:\t8192\ndrm-memory-vram:\t4096\n"));
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ(12288u, total);
+    EXPECT_EQ(12288u, pss);
+}
+
+TEST_F(DrmBackendTest, SizeSuffixes) {
+    addFd(100, 5, client("0000:00:02.0", 1,
+                         "drm-total-system:\t3 KiB\ndrm-total-vram:\t2 MiB\n"
+                         "drm-total-stolen:\t100\n"));
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ((3u << 10) + (2u << 20) + 100u, total);
+    EXPECT_EQ(total, pss);
+}
+
+TEST_F(DrmBackendTest, ClientsCountedOnce) {
+    // fds 5 and 6 are the same client.  The same client id on another device
+    // is a different client, as is a client without an id.
+    addFd(100, 5, client("0000:00:02.0", 1, "drm-total-vram:\t4 KiB\n"));
+    addFd(100, 6, client("0000:00:02.0", 1, "drm-total-vram:\t4 KiB\n"));
+    addFd(100, 7, client("0000:03:00.0", 1, "drm-total-vram:\t8 KiB\n"));
+    addFd(100, 8, client("0000:00:02.0", 2, "drm-total-vram:\t16 KiB\n"));
+    addFd(100, 9, "drm-driver:\tmsm\ndrm-total-vram:\t32 KiB\n");
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ((4u + 8u + 16u + 32u) << 10, total);
+    EXPECT_EQ(total, pss);
+}
+
+TEST_F(DrmBackendTest, SharedNotInPss) {
+    addFd(100, 5, client("0000:00:02.0", 1,
+                         "drm-total-vram:\t16 KiB\ndrm-shared-vram:\t4 KiB\n"));
+    // Shared memory is capped at the client's total.
+    addFd(100, 6, client("0000:00:02.0", 2,
+                         "drm-total-vram:\t4 KiB\ndrm-shared-vram:\t8 KiB\n"));
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ(20u << 10, total);
+    EXPECT_EQ(12u << 10, pss);
+}
+
+TEST_F(DrmBackendTest, NonDrmFdsIgnored) {
+    addFd(100, 5, "");
+    addFd(100, 6, "drm-total-vram:\t4 KiB\n");
+
+    uint64_t total, pss;
+    ASSERT_EQ(0, query(100, &total, &pss));
+    EXPECT_EQ(0u, total);
+}
+
+TEST_F(DrmBackendTest, MissingPid) {
+    addFd(100, 5, client("0000:00:02.0", 1, "drm-total-vram:\t4 KiB\n"));
+
+    uint64_t total, pss;
+    EXPECT_EQ(-ENOENT, query(200, &total, &pss));
+    EXPECT_EQ(0u, total);
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+static memtrack_snapshot_entry make_entry(pid_t pid, uint64_t graphics, uint64_t gl,
+                                          uint64_t other) {
+    memtrack_snapshot_entry e = {};
+    e.pid = pid;
+    e.start_time = 1000 + pid;
+    e.graphics_total = graphics;
+    e.graphics_pss = graphics / 2;
+    e.gl_total = gl;
+    e.gl_pss = gl;
+    e.other_total = other;
+    e.other_pss = other;
+    return e;
+}
+
+static void expect_entries_eq(const std::vector<memtrack_snapshot_entry>& expected,
+                              const std::vector<memtrack_snapshot_entry>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        SCOPED_TRACE(i);
+        EXPECT_EQ(expected[i].pid, actual[i].pid);
+        EXPECT_EQ(expected[i].start_time, actual[i].start_time);
+        EXPECT_EQ(expected[i].graphics_total, actual[i].graphics_total);
+        EXPECT_EQ(expected[i].graphics_pss, actual[i].graphics_pss);
+        EXPECT_EQ(expected[i].gl_total, actual[i].gl_total);
+        EXPECT_EQ(expected[i].gl_pss, actual[i].gl_pss);
+        EXPECT_EQ(expected[i].other_total, actual[i].other_total);
+        EXPECT_EQ(expected[i].other_pss, actual[i].other_pss);
+    }
+}
+
+class HistoryTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        in_ = memtrack_snapshot_new();
+        out_ = memtrack_snapshot_new();
+        ASSERT_NE(nullptr, in_);
+        ASSERT_NE(nullptr, out_);
+    }
+
+    void TearDown() override {
+        memtrack_snapshot_destroy(in_);
+        memtrack_snapshot_destroy(out_);
+    }
+
+    TemporaryFile file_;
+    memtrack_snapshot* in_ = nullptr;
+    memtrack_snapshot* out_ = nullptr;
+};
+
+TEST_F(HistoryTest, RoundTrip) {
+    std::vector<std::vector<memtrack_snapshot_entry>> snapshots = {
+            {make_entry(1, 64 << 20, 0, 0), make_entry(300, 0, 8 << 20, 4096),
+             make_entry(12, UINT64_MAX, UINT64_MAX, 0)},
+            {},
+            {make_entry(7, 4096, 0, 0)},
+    };
+    // pss larger than the total still round-trips.
+    snapshots[2][0].graphics_pss = 8192;
+
+    memtrack_history* h = memtrack_history_open(file_.path, 4096);
+    ASSERT_NE(nullptr, h);
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        in_->time_ns = 1000000000ULL * (i + 1);
+        in_->entries = snapshots[i];
+        ASSERT_EQ(0, memtrack_history_append(h, in_));
+    }
+    memtrack_history_close(h);
+
+    memtrack_history_reader* r = memtrack_history_reader_open(file_.path);
+    ASSERT_NE(nullptr, r);
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        SCOPED_TRACE(i);
+        ASSERT_EQ(1, memtrack_history_next(r, out_));
+        EXPECT_EQ(1000000000ULL * (i + 1), out_->time_ns);
+        expect_entries_eq(snapshots[i], out_->entries);
+    }
+    EXPECT_EQ(0, memtrack_history_next(r, out_));
+    memtrack_history_reader_close(r);
+}
+
+TEST_F(HistoryTest, CompactForTypicalEntries) {
+    // A process with 64MiB of graphics memory, half of it pss, and nothing
+    // else is a byte each of length, time, count, pid and start time, 4 of
+    // graphics_total, 4 of pss minus total and one per other size.
+    static constexpr size_t kRecordSize = 17;
+
+    memtrack_history* h = memtrack_history_open(file_.path, kRecordSize);
+    ASSERT_NE(nullptr, h);
+    in_->time_ns = 1;
+    in_->entries = {make_entry(1, 64 << 20, 0, 0)};
+    in_->entries[0].start_time = 1;
+    EXPECT_EQ(0, memtrack_history_append(h, in_));
+    in_->entries[0].graphics_total = 1 << 28;
+    EXPECT_EQ(-E2BIG, memtrack_history_append(h, in_));
+    memtrack_history_close(h);
+}
+
+TEST_F(HistoryTest, WrapsAndDropsOldest) {
+    static constexpr size_t kRingSize = 256;
+    static constexpr int kSnapshots = 40;
+
+    memtrack_history* h = memtrack_history_open(file_.path, kRingSize);
+    ASSERT_NE(nullptr, h);
+    std::vector<std::vector<memtrack_snapshot_entry>> snapshots;
+    for (int i = 0; i < kSnapshots; i++) {
+        snapshots.push_back({make_entry(100 + i, (i + 1) << 20, i * 4096, 0),
+                             make_entry(200 + i, 0, 0, i)});
+        in_->time_ns = i + 1;
+        in_->entries = snapshots.back();
+        ASSERT_EQ(0, memtrack_history_append(h, in_));
+    }
+    memtrack_history_close(h);
+
+    // The records read back are the newest ones, in order, including those
+    // that straddle the end of the ring.
+    memtrack_history_reader* r = memtrack_history_reader_open(file_.path);
+    ASSERT_NE(nullptr, r);
+    std::vector<uint64_t> times;
+    while (memtrack_history_next(r, out_) == 1) {
+        uint64_t i = out_->time_ns - 1;
+        ASSERT_LT(i, snapshots.size());
+        expect_entries_eq(snapshots[i], out_->entries);
+        times.push_back(out_->time_ns);
+    }
+    memtrack_history_reader_close(r);
+
+    ASSERT_FALSE(times.empty());
+    EXPECT_LT(times.size(), static_cast<size_t>(kSnapshots));
+    EXPECT_EQ(static_cast<uint64_t>(kSnapshots), times.back());
+    for (size_t i = 1; i < times.size(); i++) {
+        EXPECT_EQ(times[i - 1] + 1, times[i]);
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+#include "memtrack_trace_format.h"
+
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+/*
+ * Replays a trace in which the test process reports no memory of any type,
+ * so it becomes a candidate for zero skipping.  The process is real, since
+ * the snapshot checks its start time before skipping it.
+ */
+class SnapshotZeroSkipTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::string trace;
+        memtrack_trace_put_header(&trace);
+        for (uint32_t type = 0; type < MEMTRACK_NUM_TYPES; type++) {
+            memtrack_trace_put_response(&trace, getpid(), type, 0, 0, 0);
+        }
+        ASSERT_TRUE(::android::base::WriteStringToFile(trace, trace_.path));
+        ASSERT_EQ(0, memtrack_replay_load(trace_.path, 0));
+        snapshot_ = memtrack_snapshot_new();
+        ASSERT_NE(nullptr, snapshot_);
+    }
+
+    void TearDown() override {
+        memtrack_snapshot_destroy(snapshot_);
+        memtrack_set_backend(MEMTRACK_BACKEND_AUTO);
+    }
+
+    /* Take a snapshot and return how many processes it skipped. */
+    size_t sweep() {
+        EXPECT_EQ(0, memtrack_snapshot_take(snapshot_));
+        return memtrack_snapshot_skipped(snapshot_);
+    }
+
+    TemporaryFile trace_;
+    memtrack_snapshot* snapshot_ = nullptr;
+};
+
+TEST_F(SnapshotZeroSkipTest, NoFullSweeps) {
+    memtrack_snapshot_set_zero_skip(snapshot_, 100, 0);
+
+    // Queried until it has reported nothing twice, then skipped for good.
+    EXPECT_EQ(0u, sweep());
+    EXPECT_EQ(0u, sweep());
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(1u, sweep());
+    }
+}
+
+TEST_F(SnapshotZeroSkipTest, FullSweeps) {
+    memtrack_snapshot_set_zero_skip(snapshot_, 100, 4);
+
+    EXPECT_EQ(0u, sweep());
+    EXPECT_EQ(0u, sweep());
+    EXPECT_EQ(1u, sweep());
+    // The fourth sweep is a full one.
+    EXPECT_EQ(0u, sweep());
+    EXPECT_EQ(1u, sweep());
+    EXPECT_EQ(1u, sweep());
+    EXPECT_EQ(1u, sweep());
+    EXPECT_EQ(0u, sweep());
+}
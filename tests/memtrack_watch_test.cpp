@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "memtrack_internal.h"
+#include "memtrack_trace_format.h"
+
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+/* Watches are scheduled in 10ms ticks, cascaded every 256 ticks. */
+static constexpr uint64_t kTickNs = 10 * 1000000ULL;
+static constexpr uint64_t kCascadeTicks = 256;
+static constexpr uint64_t kThreshold = 1 << 20;
+
+/* The simulated clock the scheduler runs on. */
+static uint64_t now_ns;
+static uint64_t above_ns;
+
+static void on_event(memtrack_watch* /*w*/, memtrack_watch_event event, uint64_t /*size*/,
+                     void* /*cookie*/) {
+    if (event == MEMTRACK_WATCH_ABOVE) {
+        above_ns = now_ns;
+    }
+}
+
+/*
+ * Watch "far" is due 300 ticks after its first sample, so it waits in the
+ * second level of the wheel.  Watch "near" is added 120 ticks later and is
+ * due after "far", but close enough to go straight into the first level.
+ * The scheduler must still wake up for the cascade that moves "far" into
+ * the first level, and sample it on time.  The scheduler runs on a simulated
+ * clock that jumps from one of its wakeups to the next, so a missed wakeup
+ * shows up as a late sample however loaded the host is.
+ */
+TEST(WatchTest, DueBeyondCascade) {
+    // far reports no GL memory first, so it is due again after the max
+    // interval, then crosses the threshold.  near stays at a quarter of its
+    // threshold, which makes its interval 2.5s.
+    std::string trace;
+    memtrack_trace_put_header(&trace);
+    memtrack_trace_put_response(&trace, getpid(), MEMTRACK_TYPE_GL, 0, 0, 0);
+    memtrack_trace_put_response(&trace, getpid(), MEMTRACK_TYPE_GL, 0, 0, 1);
+    memtrack_trace_put_record(&trace, kThreshold, kMemtrackTraceSmapsUnaccounted);
+    memtrack_trace_put_response(&trace, getpid(), MEMTRACK_TYPE_GRAPHICS, 0, 0, 1);
+    memtrack_trace_put_record(&trace, kThreshold / 4, kMemtrackTraceSmapsUnaccounted);
+    TemporaryFile file;
+    ASSERT_TRUE(::android::base::WriteStringToFile(trace, file.path));
+    ASSERT_EQ(0, memtrack_replay_load(file.path, 0));
+    ASSERT_EQ(0, memtrack_watch_set_intervals(1000, 3000));
+
+    memtrack_proc_id id;
+    ASSERT_EQ(0, memtrack_proc_id_get(getpid(), &id));
+
+    // Start 10 ticks into a cascade period, so the cascade that moves far
+    // comes after near is added.
+    uint64_t start = (1000 * kCascadeTicks + 10) * kTickNs;
+    now_ns = start;
+    ASSERT_EQ(0, memtrack_watch_set_clock(&now_ns));
+    memtrack_watch* far = memtrack_watch_add(&id, MEMTRACK_TYPE_MASK(MEMTRACK_TYPE_GL), kThreshold,
+                                             on_event, nullptr);
+    ASSERT_NE(nullptr, far);
+    memtrack_watch_run_until(start + 1200 * 1000000ULL);
+    memtrack_watch* near = memtrack_watch_add(&id, MEMTRACK_TYPE_MASK(MEMTRACK_TYPE_GRAPHICS),
+                                              kThreshold, on_event, nullptr);
+    ASSERT_NE(nullptr, near);
+    memtrack_watch_run_until(start + 4700 * 1000000ULL);
+
+    EXPECT_EQ(0, memtrack_watch_remove(near));
+    EXPECT_EQ(0, memtrack_watch_remove(far));
+    memtrack_watch_set_clock(nullptr);
+    memtrack_watch_set_intervals(100, 5000);
+    memtrack_set_backend(MEMTRACK_BACKEND_AUTO);
+
+    // far is first sampled on the tick after it is added, and due again 300
+    // ticks later.
+    EXPECT_EQ(start + 301 * kTickNs, above_ns);
+}